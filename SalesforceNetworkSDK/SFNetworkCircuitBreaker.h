@@ -0,0 +1,79 @@
+//
+//  SFNetworkCircuitBreaker.h
+//  SalesforceNetworkSDK
+//
+//  Copyright (c) 2013 salesforce.com. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/** State of a `SFNetworkCircuitBreaker`
+
+- SFNetworkCircuitBreakerStateClosed: Endpoint is healthy, all requests are sent
+- SFNetworkCircuitBreakerStateOpen: Endpoint is failing, all requests fail immediately with `SFNetworkOperationErrorTypeCircuitOpen` error
+- SFNetworkCircuitBreakerStateHalfOpen: Open duration has elapsed, a single probe request is sent to test whether the endpoint has recovered
+ */
+typedef enum {
+    SFNetworkCircuitBreakerStateClosed = 0,
+    SFNetworkCircuitBreakerStateOpen,
+    SFNetworkCircuitBreakerStateHalfOpen
+} SFNetworkCircuitBreakerState;
+
+@class SFNetworkCircuitBreaker;
+
+typedef void (^SFNetworkCircuitBreakerStateChangedBlock)(SFNetworkCircuitBreaker *circuitBreaker, SFNetworkCircuitBreakerState state);
+
+/**
+ Tracks the outcome of recent requests sent to one endpoint and decides whether new requests should be sent to it
+
+ The breaker opens when at least `minimumNumOfRequests` of the last requests have been recorded and the ratio of failed requests
+ reaches `failureRateThreshold`. After `openDuration` it lets a single probe request through. The breaker closes if the probe
+ succeeds and opens again if it fails. Outcome of any other request that finishes meanwhile is ignored.
+ */
+@interface SFNetworkCircuitBreaker : NSObject
+
+/** Endpoint this breaker is tracking */
+@property (nonatomic, readonly, copy) NSString *endpointKey;
+
+/** Current state */
+@property (nonatomic, readonly, assign) SFNetworkCircuitBreakerState state;
+
+/** Ratio of failed requests, between 0 and 1, at which the breaker opens */
+@property (nonatomic, readonly, assign) double failureRateThreshold;
+
+/** Minimum number of recorded requests before the breaker can open */
+@property (nonatomic, readonly, assign) NSUInteger minimumNumOfRequests;
+
+/** Time in seconds the breaker stays open before letting a probe request through */
+@property (nonatomic, readonly, assign) NSTimeInterval openDuration;
+
+/** Block invoked each time `state` changes, outside of any lock on a serial background queue, in the order the changes happened */
+@property (nonatomic, copy) SFNetworkCircuitBreakerStateChangedBlock stateChangedHandler;
+
+/** Create new SFNetworkCircuitBreaker
+
+ @param endpointKey Endpoint to track
+ @param failureRateThreshold Ratio of failed requests at which the breaker opens
+ @param minimumNumOfRequests Minimum number of recorded requests before the breaker can open
+ @param openDuration Time in seconds the breaker stays open before letting a probe request through
+ */
+- (id)initWithEndpointKey:(NSString *)endpointKey failureRateThreshold:(double)failureRateThreshold minimumNumOfRequests:(NSUInteger)minimumNumOfRequests openDuration:(NSTimeInterval)openDuration;
+
+/** Return YES if a new request should be sent to the endpoint
+
+ Returns YES when the breaker is closed. When the breaker is open and `openDuration` has elapsed, moves to
+ `SFNetworkCircuitBreakerStateHalfOpen` and returns YES for a single probe request
+
+ @param probeToken Set to a non-zero token identifying the request if it is the probe request, 0 otherwise. Can be NULL
+ */
+- (BOOL)allowRequestWithProbeToken:(NSUInteger *)probeToken;
+
+/** Record the outcome of a request sent to the endpoint
+
+ While the breaker is half-open, only the outcome of the current probe request is taken into account
+
+ @param succeeded NO if the request failed in a way that indicates the endpoint is unhealthy
+ @param probeToken Token returned by `allowRequestWithProbeToken:` when the request was sent
+ */
+- (void)recordRequestSucceeded:(BOOL)succeeded probeToken:(NSUInteger)probeToken;
+@end
@@ -0,0 +1,198 @@
+//
+//  SFNetworkCircuitBreaker.m
+//  SalesforceNetworkSDK
+//
+//  Copyright (c) 2013 salesforce.com. All rights reserved.
+//
+
+#import "SFNetworkCircuitBreaker.h"
+
+static NSUInteger const kMinimumWindowSize = 20;
+
+@interface SFNetworkCircuitBreaker ()
+@property (nonatomic, readwrite, assign) SFNetworkCircuitBreakerState state;
+
+/** Outcome of the most recent requests, oldest first. Holds at most `windowSize` values */
+@property (nonatomic, strong) NSMutableArray *recentOutcomes;
+
+/** Maximum number of outcomes kept in `recentOutcomes` */
+@property (nonatomic, assign) NSUInteger windowSize;
+
+/** Time the breaker was last opened */
+@property (nonatomic, assign) NSTimeInterval openedTime;
+
+/** Time the current probe request was let through. 0 if no probe is running */
+@property (nonatomic, assign) NSTimeInterval probeStartTime;
+
+/** Token handed to the current probe request. 0 if no probe is running */
+@property (nonatomic, assign) NSUInteger probeToken;
+
+/** Last token handed to a probe request. Tokens are never reused */
+@property (nonatomic, assign) NSUInteger lastProbeToken;
+
+/** Let a new probe request through and return its token. Must be called within @synchronized(self)
+
+ @param time Current time
+ */
+- (NSUInteger)startProbeAtTime:(NSTimeInterval)time;
+
+/** Change `state` and queue a call to `notifyStateChanged:` if it is different from the current state. Must be called within @synchronized(self)
+
+ @param state New state
+ */
+- (void)transitionToState:(SFNetworkCircuitBreakerState)state;
+
+/** Invoke `stateChangedHandler` with the specified state on a serial queue
+
+ Must be called within @synchronized(self), so that handlers are queued, and so invoked, in the same order as the state changes
+
+ @param state New state
+ */
+- (void)notifyStateChanged:(SFNetworkCircuitBreakerState)state;
+
+/** Serial queue shared by all circuit breakers to invoke `stateChangedHandler` outside of any lock */
++ (dispatch_queue_t)stateChangedQueue;
+@end
+
+@implementation SFNetworkCircuitBreaker
+@synthesize endpointKey = _endpointKey;
+@synthesize state = _state;
+@synthesize failureRateThreshold = _failureRateThreshold;
+@synthesize minimumNumOfRequests = _minimumNumOfRequests;
+@synthesize openDuration = _openDuration;
+@synthesize stateChangedHandler = _stateChangedHandler;
+@synthesize recentOutcomes = _recentOutcomes;
+@synthesize windowSize = _windowSize;
+@synthesize openedTime = _openedTime;
+@synthesize probeStartTime = _probeStartTime;
+@synthesize probeToken = _probeToken;
+@synthesize lastProbeToken = _lastProbeToken;
+
+#pragma mark - Initialization
+- (id)initWithEndpointKey:(NSString *)endpointKey failureRateThreshold:(double)failureRateThreshold minimumNumOfRequests:(NSUInteger)minimumNumOfRequests openDuration:(NSTimeInterval)openDuration {
+    self = [super init];
+    if (self) {
+        _endpointKey = [endpointKey copy];
+        _state = SFNetworkCircuitBreakerStateClosed;
+        _failureRateThreshold = failureRateThreshold;
+        _minimumNumOfRequests = MAX(minimumNumOfRequests, 1);
+        _openDuration = openDuration;
+        _windowSize = MAX(_minimumNumOfRequests, kMinimumWindowSize);
+        _recentOutcomes = [[NSMutableArray alloc] initWithCapacity:_windowSize];
+    }
+    return self;
+}
+
+#pragma mark - Admission
+- (BOOL)allowRequestWithProbeToken:(NSUInteger *)probeToken {
+    NSUInteger newProbeToken = 0;
+    if (probeToken) {
+        *probeToken = 0;
+    }
+    @synchronized(self) {
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        switch (self.state) {
+            case SFNetworkCircuitBreakerStateClosed:
+                return YES;
+            case SFNetworkCircuitBreakerStateOpen:
+                if (now - self.openedTime < self.openDuration) {
+                    return NO;
+                }
+                [self transitionToState:SFNetworkCircuitBreakerStateHalfOpen];
+                newProbeToken = [self startProbeAtTime:now];
+                break;
+            case SFNetworkCircuitBreakerStateHalfOpen:
+                //Let another probe through if the previous one never reported back, e.g. because it was cancelled
+                if (self.probeStartTime > 0 && now - self.probeStartTime < self.openDuration) {
+                    return NO;
+                }
+                newProbeToken = [self startProbeAtTime:now];
+                break;
+        }
+    }
+    if (probeToken) {
+        *probeToken = newProbeToken;
+    }
+    return YES;
+}
+
+- (NSUInteger)startProbeAtTime:(NSTimeInterval)time {
+    self.lastProbeToken++;
+    self.probeToken = self.lastProbeToken;
+    self.probeStartTime = time;
+    return self.probeToken;
+}
+
+#pragma mark - Outcome
+- (void)recordRequestSucceeded:(BOOL)succeeded probeToken:(NSUInteger)probeToken {
+    @synchronized(self) {
+        if (self.state == SFNetworkCircuitBreakerStateHalfOpen) {
+            if (0 == probeToken || probeToken != self.probeToken) {
+                //Not the current probe, e.g. a request sent before the breaker opened
+                return;
+            }
+            //Outcome of the probe decides whether the endpoint has recovered
+            [self.recentOutcomes removeAllObjects];
+            self.probeStartTime = 0;
+            self.probeToken = 0;
+            if (succeeded) {
+                [self transitionToState:SFNetworkCircuitBreakerStateClosed];
+            } else {
+                self.openedTime = [NSDate timeIntervalSinceReferenceDate];
+                [self transitionToState:SFNetworkCircuitBreakerStateOpen];
+            }
+        } else if (self.state == SFNetworkCircuitBreakerStateClosed) {
+            if (self.recentOutcomes.count >= self.windowSize) {
+                [self.recentOutcomes removeObjectAtIndex:0];
+            }
+            [self.recentOutcomes addObject:@(succeeded)];
+
+            if (self.recentOutcomes.count >= self.minimumNumOfRequests) {
+                NSUInteger numOfFailures = 0;
+                for (NSNumber *outcome in self.recentOutcomes) {
+                    if (![outcome boolValue]) {
+                        numOfFailures++;
+                    }
+                }
+                if ((double)numOfFailures / self.recentOutcomes.count >= self.failureRateThreshold) {
+                    [self.recentOutcomes removeAllObjects];
+                    self.openedTime = [NSDate timeIntervalSinceReferenceDate];
+                    [self transitionToState:SFNetworkCircuitBreakerStateOpen];
+                }
+            }
+        }
+        //When open, outcome of requests sent before the breaker opened is ignored
+    }
+}
+
+#pragma mark - State Change
+- (void)transitionToState:(SFNetworkCircuitBreakerState)state {
+    if (_state == state) {
+        return;
+    }
+    self.state = state;
+    [self notifyStateChanged:state];
+}
+
+- (void)notifyStateChanged:(SFNetworkCircuitBreakerState)state {
+    SFNetworkCircuitBreakerStateChangedBlock handler = self.stateChangedHandler;
+    if (handler) {
+        dispatch_async([[self class] stateChangedQueue], ^{
+            handler(self, state);
+        });
+    }
+}
+
++ (dispatch_queue_t)stateChangedQueue {
+    static dispatch_queue_t stateChangedQueue = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        stateChangedQueue = dispatch_queue_create("com.salesforce.network.circuitbreaker.statechanged", DISPATCH_QUEUE_SERIAL);
+    });
+    return stateChangedQueue;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %@ state %d>", NSStringFromClass([self class]), _endpointKey, _state];
+}
+@end
@@ -10,6 +10,8 @@
 #import "SFNetworkOperation.h"
 #import "SFNetworkEngine.h"
 
+@class SFNetworkHedge;
+
 @interface SFNetworkEngine ()
 
 @property (nonatomic, strong) MKNetworkEngine *internalNetworkEngine;
@@ -27,6 +29,22 @@
  */
 @property NSMutableArray *operationsWaitingForNetwork;
 
+/** Queue to store all operations queued up due to memory budget
+ 
+ This queue will contain all operations that could not be started without exceeding `maximumInFlightBytes`, in the order they were enqueued
+ */
+@property NSMutableArray *operationsWaitingForMemoryBudget;
+
+/** Bytes charged against `maximumInFlightBytes`, keyed by internal `MKNetworkOperation` of running operations
+ */
+@property (nonatomic, strong) NSMapTable *operationsChargedToMemoryBudget;
+
+/** Content length of the last response received from each endpoint, keyed by endpoint. See `endpointKeyForURL:`
+ 
+ Used as the expected download size of operations that do not set `[SFNetworkOperation expectedDownloadSize]`
+ */
+@property (nonatomic, strong) NSMutableDictionary *endpointResponseSizes;
+
 
 /** Flag to indicate whether or not `SFNetworkEngine` token refresh flow is in progress or not
  */
@@ -36,6 +54,39 @@
  */
 @property (nonatomic, assign) BOOL networkChangeShouldTriggerTokenRefresh;
 
+/** Recent response latencies in seconds, keyed by endpoint. See `endpointKeyForURL:`
+ */
+@property (nonatomic, strong) NSMutableDictionary *endpointLatencies;
+
+/** Duplicate requests that may currently be sent for hedged operations
+ 
+ Every hedged operation adds `hedgeBudget` tokens, up to a small maximum, and every duplicate request sent takes one token
+ */
+@property (nonatomic, assign) double hedgeTokens;
+
+/** Queue used to run duplicate requests sent for hedged operations
+ 
+ Duplicate requests bypass the internal network engine, which would otherwise merge them with the original request.
+ The queue runs a limited number of requests at a time and is suspended together with the internal network engine
+ */
+@property (nonatomic, strong) NSOperationQueue *hedgeQueue;
+
+/** Circuit breakers keyed by endpoint. See `endpointKeyForURL:` and `enableCircuitBreakers`
+ */
+@property (nonatomic, strong) NSMutableDictionary *circuitBreakers;
+
+/** Start time of operations being recorded, keyed by internal `MKNetworkOperation`
+ 
+ See `transportMode` for more details
+ */
+@property (nonatomic, strong) NSMapTable *operationsBeingRecorded;
+
+/** Queue used to run operations served from `sessionArchive`
+
+ Replayed operations bypass the internal network engine, which would otherwise merge concurrent operations with the same unique identifier and serve them all the same recorded response
+ */
+@property (nonatomic, strong) NSOperationQueue *replayQueue;
+
 
 /** Read and return data from local test file
  
@@ -45,6 +96,187 @@
  */
 - (NSData *)readDataFromTestFile:(NSString *)localDataFilePath;
 
+///---------------------------------------------------------------
+/// @name Memory Budget Methods
+///---------------------------------------------------------------
+/** Return the number of bytes of in-memory file data posted by an internal operation
+ 
+ @param internalOperation Internal operation to check
+ */
+- (NSUInteger)postedBytesForOperation:(MKNetworkOperation *)internalOperation;
+
+/** Return the expected response size of `SFNetworkOperation`
+ 
+ Returns `[SFNetworkOperation expectedDownloadSize]` if set, or else the size of the last response received from the same endpoint. See `endpointResponseSizes`
+ 
+ @param operation Operation to estimate
+ */
+- (NSUInteger)expectedDownloadSizeForOperation:(SFNetworkOperation *)operation;
+
+/** Return the number of bytes `SFNetworkOperation` is expected to buffer in memory while running
+ 
+ @param operation Operation to estimate
+ */
+- (NSUInteger)bufferedBytesForOperation:(SFNetworkOperation *)operation;
+
+/** Replace the estimated charge of a running internal operation with the content length of its response, and remember that length for the endpoint
+ 
+ Invoked once the response headers are received. Operations waiting for memory budget are started if the charge went down
+ 
+ @param internalOperation Internal operation that received its response headers
+ @param url Full request URL
+ */
+- (void)updateChargeOfOperation:(MKNetworkOperation *)internalOperation forURL:(NSString *)url;
+
+/** Return the number of bytes currently charged against `maximumInFlightBytes` by running operations
+ */
+- (NSUInteger)inFlightBytes;
+
+/** Return YES if `SFNetworkOperation` can be started within `maximumInFlightBytes`
+ 
+ If it cannot, the operation is added to `operationsWaitingForMemoryBudget` and will be started by `startOperationsWaitingForMemoryBudget`,
+ which is also invoked before returning NO in case budget was released without any handler being called
+ 
+ @param operation Operation about to be started
+ */
+- (BOOL)admitOperationWithinMemoryBudget:(SFNetworkOperation *)operation;
+
+/** Start operations stored in `operationsWaitingForMemoryBudget` queue for as long as they fit in `maximumInFlightBytes`
+ */
+- (void)startOperationsWaitingForMemoryBudget;
+
+/** Send `SFNetworkOperation` to the internal network engine
+ 
+ @param operation Operation admitted by `admitOperationWithinMemoryBudget:`
+ */
+- (void)startOperation:(SFNetworkOperation *)operation;
+
+///---------------------------------------------------------------
+/// @name Hedging Methods
+///---------------------------------------------------------------
+/** Return the key used to group requests sent to the same endpoint
+ 
+ The key is made of the host and the URL path, with path segments that look like record IDs or numbers replaced by a placeholder.
+ It is used for latency statistics and circuit breakers
+ 
+ @param url Full request URL
+ */
+- (NSString *)endpointKeyForURL:(NSString *)url;
+
+/** Add a response latency to `endpointLatencies`
+ 
+ @param latency Response latency in seconds
+ @param endpointKey Endpoint key. See `endpointKeyForURL:`
+ */
+- (void)recordLatency:(NSTimeInterval)latency forEndpoint:(NSString *)endpointKey;
+
+/** Return delay in seconds before a duplicate request is sent for `SFNetworkOperation`
+ 
+ @param operation Hedged operation
+ */
+- (NSTimeInterval)hedgeDelayForOperation:(SFNetworkOperation *)operation;
+
+/** Return YES if `SFNetworkOperation` can safely be sent more than once
+ 
+ @param operation Operation to check
+ */
+- (BOOL)isIdempotentOperation:(SFNetworkOperation *)operation;
+
+/** Create `[SFNetworkOperation hedge]` if `SFNetworkOperation` is hedged, and add its share of `hedgeBudget` to `hedgeTokens`
+ 
+ @param operation Operation about to be sent to the remote server
+ */
+- (void)scheduleHedgeForOperation:(SFNetworkOperation *)operation;
+
+/** Create `[SFNetworkOperation startObserver]` if the time `SFNetworkOperation` is sent is needed
+ 
+ The start time is needed by hedged operations, whose duplicate request is armed once the original request is sent (see `armHedgeForOperation:hedge:afterDelay:`),
+ and by `circuitBreakerSlowResponseThreshold`
+ 
+ @param operation Operation about to be sent to the remote server
+ */
+- (void)observeStartOfOperation:(SFNetworkOperation *)operation;
+
+/** Invoke `startHedgeForOperation:hedge:` after the specified delay
+ 
+ @param operation Hedged operation
+ @param hedge Hedge created by `scheduleHedgeForOperation:`
+ @param delay Delay in seconds
+ */
+- (void)armHedgeForOperation:(SFNetworkOperation *)operation hedge:(SFNetworkHedge *)hedge afterDelay:(NSTimeInterval)delay;
+
+/** Send a duplicate request for `SFNetworkOperation` if it is still running and `hedgeTokens` allows it
+ 
+ @param operation Hedged operation
+ @param hedge Hedge created by `scheduleHedgeForOperation:`
+ */
+- (void)startHedgeForOperation:(SFNetworkOperation *)operation hedge:(SFNetworkHedge *)hedge;
+
+///---------------------------------------------------------------
+/// @name Endpoint Health Methods
+///---------------------------------------------------------------
+/** Record latency and outcome of `SFNetworkOperation` for its endpoint
+ 
+ Latency of hedged operations, measured from the time the request is sent, is added to `endpointLatencies` when `adaptiveHedgeDelay` is YES.
+ Outcome is recorded by the circuit breaker of the endpoint when `enableCircuitBreakers` is YES
+ 
+ @param operation Operation about to be sent to the remote server
+ */
+- (void)trackResponseOfOperation:(SFNetworkOperation *)operation;
+
+/** Return YES if error indicates the endpoint is unhealthy, i.e. an internal server error, API limit error, or a time out while the network is reachable
+ 
+ Connectivity errors of the device are never counted against the endpoint
+ 
+ @param error Error received on the operation
+ */
+- (BOOL)isEndpointFailure:(NSError *)error;
+
+/** Return the circuit breaker for the endpoint of the specified URL, creating it if needed
+ 
+ @param url Full request URL
+ */
+- (SFNetworkCircuitBreaker *)circuitBreakerForURL:(NSString *)url;
+
+///---------------------------------------------------------------
+/// @name Record & Replay Methods
+///---------------------------------------------------------------
+/** Start recording response of `SFNetworkOperation` into `sessionArchive`
+ 
+ @param operation Operation about to be sent to the remote server
+ */
+- (void)startRecordingOperation:(SFNetworkOperation *)operation;
+
+/** Append response of a completed operation to `sessionArchive`
+ 
+ Operation that is not started by `startRecordingOperation:`, or that failed without receiving a response, will be ignored
+ 
+ @param operation Completed internal operation
+ */
+- (void)finishRecordingOperation:(MKNetworkOperation *)operation;
+
+/** Return the key used to record and replay the response of an internal operation
+ 
+ `[MKNetworkOperation uniqueIdentifier]` only covers the HTTP method and URL. A hash of the posted fields and file data is appended so that
+ requests posting different bodies to the same URL are recorded separately
+ 
+ @param operation Internal operation
+ */
+- (NSString *)recordingKeyForOperation:(MKNetworkOperation *)operation;
+
+/** Serve `SFNetworkOperation` from `sessionArchive` without opening a connection
+ 
+ @param operation Operation to serve
+ */
+- (void)replayOperation:(SFNetworkOperation *)operation;
+
+/** Invoke error blocks of `SFNetworkOperation` without executing it
+ 
+ @param operation Operation to fail
+ @param error Error passed to the error blocks
+ */
+- (void)failOperation:(SFNetworkOperation *)operation withError:(NSError *)error;
+
 ///---------------------------------------------------------------
 /// @name Access Token Refresh Method
 ///---------------------------------------------------------------
@@ -60,8 +292,13 @@
 - (void)queueOperationOnExpiredAccessToken:(SFNetworkOperation *)operation;
 
 /** Queue `SFNetworkOperation` due to network error
+ 
+ If the error is not counted against the endpoint, see `isEndpointFailure:`, the retried operation bypasses its circuit breaker
+ 
+ @param operation Operation that failed
+ @param error Network error received on the operation
  */
-- (void)queueOperationOnNetworkError:(SFNetworkOperation *)operation;
+- (void)queueOperationOnNetworkError:(SFNetworkOperation *)operation error:(NSError *)error;
 
 /** Replay all operations stored in `operationsWaitingForNetwork` queue
  */
@@ -9,6 +9,8 @@
 #import <Foundation/Foundation.h>
 #import "SFNetworkOperation.h"
 #import "SFNetworkCoordinator.h"
+#import "SFNetworkSessionArchive.h"
+#import "SFNetworkCircuitBreaker.h"
 
 // Salesforce's wrapper around common Reachability NetworkStatus Compatible Names.
 typedef enum {
@@ -17,6 +19,18 @@ typedef enum {
 	SFReachableViaWWAN = 1
 } SFNetworkStatus;
 
+/** Transport used by `SFNetworkEngine` to execute `SFNetworkOperation`
+
+- SFNetworkTransportModeLive: Send all operations to the remote server
+- SFNetworkTransportModeRecord: Send all operations to the remote server and append every response to `[SFNetworkEngine sessionArchive]`
+- SFNetworkTransportModeReplay: Serve all operations from `[SFNetworkEngine sessionArchive]` without opening a connection
+ */
+typedef enum {
+    SFNetworkTransportModeLive = 0,
+    SFNetworkTransportModeRecord,
+    SFNetworkTransportModeReplay
+} SFNetworkTransportMode;
+
 extern NSString * const SFNetworkOperationGetMethod;
 extern NSString * const SFNetworkOperationPostMethod;
 extern NSString * const SFNetworkOperationPutMethod;
@@ -30,6 +44,17 @@ extern NSString * const SFNetworkOperationHeadMethod;
  */
 extern NSString * const SFNetworkOperationReachabilityChangedNotification;
 
+/** Notification that will be posted when the state of a circuit breaker changes
+ 
+ When posted, `SFNetworkCircuitBreakerState` will wraped in NSNumber as the `[notification object]`, and the endpoint key will be
+ stored in `[notification userInfo]` under `SFNetworkCircuitBreakerEndpointKey`. See `[SFNetworkEngine enableCircuitBreakers]`
+ */
+extern NSString * const SFNetworkOperationCircuitBreakerStateChangedNotification;
+
+/** Key of the endpoint in `SFNetworkOperationCircuitBreakerStateChangedNotification` user info
+ */
+extern NSString * const SFNetworkCircuitBreakerEndpointKey;
+
 /** Notification that will be posted when SFNetworkEngine cancels all operations
  */
 extern NSString * const SFNetworkOperationEngineOperationCancelledNotification;
@@ -122,9 +147,108 @@ extern NSString * const SFNetworkOperationEngineResumedNotification;
  following the normal flow
  
  Make sure you set this property to NO in release build
+ 
+ This only serves a static response body. Use `transportMode` with a `sessionArchive` to replay recorded status codes, headers and timing
 */
 @property (nonatomic, assign) BOOL supportLocalTestData;
 
+/** Transport used to execute operations. Default value is `SFNetworkTransportModeLive`
+ 
+ When set to `SFNetworkTransportModeRecord`, every completed operation is appended to `sessionArchive`, which can then be saved
+ with `[SFNetworkSessionArchive writeToFile:error:]`.
+ 
+ When set to `SFNetworkTransportModeReplay`, `[SFNetworkEngine enqueueOperation]` serves the operation from `sessionArchive`
+ after the delay configured by `[SFNetworkSessionArchive replayLatency]` and invokes completion or error blocks following the normal flow.
+ Operation that has no recorded response fails with `NSURLErrorFileDoesNotExist` error
+ 
+ Responses are matched by HTTP method, URL and a hash of the posted fields and file data. Operations that fail without receiving a response,
+ e.g. on a network error, are not recorded. `[SFNetworkOperation responseHeaders]` of a replayed operation returns all recorded response headers,
+ whereas a live operation only returns its cache headers
+ 
+ Make sure you set this property to `SFNetworkTransportModeLive` in release build
+ */
+@property (nonatomic, assign) SFNetworkTransportMode transportMode;
+
+/** Archive used to record or replay responses. See `transportMode` for more details
+ 
+ If this property is nil when an operation is recorded, a new empty `SFNetworkSessionArchive` is created
+ */
+@property (strong) SFNetworkSessionArchive *sessionArchive;
+
+/** Maximum number of bytes that all running operations may buffer in memory. Default value is 0, i.e. no limit
+ 
+ Each operation is charged for its in-memory upload data plus its `[SFNetworkOperation expectedDownloadSize]`, unless the
+ response is written to a file (see `pathToStoreDownloadedContent` and `spillThresholdBytes`). Operations that do not set an expected
+ download size are charged for the last response size seen from the same endpoint, and the charge is corrected to the actual
+ Content-Length once the response headers are received.
+ When starting an operation would exceed this budget, the operation waits until enough running operations finish. An operation
+ is always started when no other operation is running, so a single operation larger than the budget can still complete
+ */
+@property (nonatomic, assign) NSUInteger maximumInFlightBytes;
+
+/** Expected response size in bytes above which the response is written to a temporary file instead of being buffered in memory. Default value is 0, i.e. never
+ 
+ Only applies to operations that set `[SFNetworkOperation encryptDownloadedFile]` to NO and do not set `[SFNetworkOperation pathToStoreDownloadedContent]`.
+ The response size is `[SFNetworkOperation expectedDownloadSize]` if set, or else the last response size seen from the same endpoint.
+ Temporary files are not encrypted, which is why operations that keep the default `encryptDownloadedFile` value are never spilled.
+ `[SFNetworkOperation responseAsData]` of such operation returns the memory-mapped content of the temporary file, which is
+ deleted when the operation is deallocated. Temporary files left over by a previous run are deleted when the engine is created.
+ Temporary files are created with `NSFileProtectionComplete`, so they can only be read or written while the device is unlocked.
+ Responses are never spilled when `transportMode` is `SFNetworkTransportModeRecord`, as the recorded body is kept in `sessionArchive` anyway
+ */
+@property (nonatomic, assign) NSUInteger spillThresholdBytes;
+
+/** Delay in seconds before a duplicate request is sent for an operation with `[SFNetworkOperation hedgeOnSlowResponse]` set to YES. Default value is 2 seconds
+ 
+ The delay starts when the request is actually sent, not while it waits for a free connection in the engine queue
+ */
+@property (nonatomic, assign) NSTimeInterval hedgeDelay;
+
+/** Set to YES to use the observed 95th percentile latency of an endpoint instead of `hedgeDelay` once enough responses have been received from it. Default value is YES
+ 
+ Latency is only measured on operations with `[SFNetworkOperation hedgeOnSlowResponse]` set to YES
+ */
+@property (nonatomic, assign) BOOL adaptiveHedgeDelay;
+
+/** Maximum ratio of duplicate requests to operations with `[SFNetworkOperation hedgeOnSlowResponse]` set to YES. Default value is 0.05, i.e. at most 5% extra requests
+ 
+ Each hedged operation earns `hedgeBudget` of a duplicate request, and a duplicate request is only sent once a whole one has been earned.
+ At most 3 unused duplicate requests are kept, so that a quiet period can not be followed by a burst of duplicates while an endpoint is slow
+ */
+@property (nonatomic, assign) double hedgeBudget;
+
+/** Set to YES to fail operations immediately when their endpoint keeps failing. Default value is NO
+ 
+ When enabled, `SFNetworkEngine` keeps a `SFNetworkCircuitBreaker` per host and URL template, where path segments that look like
+ record IDs or numbers are replaced by a placeholder. An operation counts as failed for its endpoint when it fails with
+ `SFNetworkOperationErrorTypeInternalServerError` or `SFNetworkOperationErrorTypeAPILimitReached`, when it times out while the network is reachable,
+ or when it takes longer than `circuitBreakerSlowResponseThreshold`. Other network errors, such as no connectivity, are never counted.
+ 
+ While a breaker is open, `[SFNetworkEngine enqueueOperation]` invokes the operation's error blocks with a `SFNetworkOperationErrorTypeCircuitOpen`
+ error instead of sending it. Operations retried because of a connectivity error (see `[SFNetworkOperation retryOnNetworkError]`) are always sent,
+ operations retried after a time out are not.
+ `SFNetworkOperationCircuitBreakerStateChangedNotification` is posted each time a breaker changes state
+ */
+@property (nonatomic, assign) BOOL enableCircuitBreakers;
+
+/** Ratio of failed operations, between 0 and 1, at which a circuit breaker opens. Default value is 0.5
+ */
+@property (nonatomic, assign) double circuitBreakerFailureRateThreshold;
+
+/** Minimum number of recent operations sent to an endpoint before its circuit breaker can open. Default value is 10
+ */
+@property (nonatomic, assign) NSUInteger circuitBreakerMinimumNumOfRequests;
+
+/** Time in seconds after which a successful operation is counted as failed by its circuit breaker. Default value is 0, i.e. latency is not considered
+ 
+ Response time is measured from the time the request is sent, not while it waits for a free connection in the engine queue
+ */
+@property (nonatomic, assign) NSTimeInterval circuitBreakerSlowResponseThreshold;
+
+/** Time in seconds a circuit breaker stays open before a probe operation is sent to test whether the endpoint has recovered. Default value is 30 seconds
+ */
+@property (nonatomic, assign) NSTimeInterval circuitBreakerOpenDuration;
+
 /**Set to true to suspend all pending requests when app enters background. Default is YES*/
 @property (nonatomic, assign, getter = shouldSuspendRequestsWhenAppEntersBackground) BOOL suspendRequestsWhenAppEntersBackground;
 
@@ -238,12 +362,15 @@ extern NSString * const SFNetworkOperationEngineResumedNotification;
 - (void)failOperationsWaitingForAccessTokenWithError:(NSError *)error;
 
 /** Cancel all operations that are waiting to be excecuted
+ 
+ This includes operations waiting for `maximumInFlightBytes` budget
  */
 - (void)cancelAllOperations;
 
 /** Cancel all operations with a specific tag that are waiting to be excecuted
  
- This method will cancel all operations that are either running or waiting to be executed that matches the specific operation tag
+ This method will cancel all operations that are either running or waiting to be executed that matches the specific operation tag,
+ including duplicate requests of hedged operations and operations waiting for `maximumInFlightBytes` budget
  
   @param operationTag Operation tag
  */
@@ -13,6 +13,7 @@
 #import "SFNetworkOperation+Internal.h"
 #import "SFNetworkEngine+Internal.h"
 #import "SFNetworkUtils.h"
+#import <CommonCrypto/CommonDigest.h>
 
 #pragma mark - Operation Method
 NSString * const SFNetworkOperationGetMethod = @"GET";
@@ -24,11 +25,24 @@ NSString * const SFNetworkOperationHeadMethod = @"HEAD";
 
 #pragma mark - Notification Name
 NSString * const SFNetworkOperationReachabilityChangedNotification = @"SFNetworkOperationReachabilityChangedNotification";
+NSString * const SFNetworkOperationCircuitBreakerStateChangedNotification = @"SFNetworkOperationCircuitBreakerStateChangedNotification";
+NSString * const SFNetworkCircuitBreakerEndpointKey = @"SFNetworkCircuitBreakerEndpointKey";
 NSString * const SFNetworkOperationEngineOperationCancelledNotification = @"SFNetworkOperationEngineOperationCancelledNotification";
 NSString * const SFNetworkOperationEngineSuspendedNotification = @"SFNetworkOperationEngineSuspendedNotification";
 NSString * const SFNetworkOperationEngineResumedNotification = @"SFNetworkOperationEngineResumedNotification";
 
 static NSInteger const kDefaultTimeOut = 3 * 60; //3 minutes
+static NSTimeInterval const kDefaultHedgeDelay = 2.0;
+static double const kDefaultHedgeBudget = 0.05;
+static double const kHedgeLatencyPercentile = 0.95;
+static NSUInteger const kMinimumLatencySamples = 20;
+static NSUInteger const kMaximumLatencySamples = 100;
+static double const kMaximumHedgeTokens = 3.0;
+static NSInteger const kMaximumConcurrentHedges = 2;
+static double const kDefaultCircuitBreakerFailureRateThreshold = 0.5;
+static NSUInteger const kDefaultCircuitBreakerMinimumNumOfRequests = 10;
+static NSTimeInterval const kDefaultCircuitBreakerOpenDuration = 30.0;
+static NSString * const kEndpointIdPlaceholder = @"{id}";
 
 static NSString * const kAuthoriationHeader = @"OAuth %@";
 static NSString * const kAuthoriationHeaderKey = @"Authorization";
@@ -75,6 +89,27 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
 @synthesize enableHttpPipeling = _enableHttpPipeling;
 @synthesize supportLocalTestData = _supportLocalTestData;
 @synthesize networkStatus = _networkStatus;
+@synthesize transportMode = _transportMode;
+@synthesize sessionArchive = _sessionArchive;
+@synthesize operationsBeingRecorded = _operationsBeingRecorded;
+@synthesize replayQueue = _replayQueue;
+@synthesize maximumInFlightBytes = _maximumInFlightBytes;
+@synthesize spillThresholdBytes = _spillThresholdBytes;
+@synthesize operationsWaitingForMemoryBudget = _operationsWaitingForMemoryBudget;
+@synthesize operationsChargedToMemoryBudget = _operationsChargedToMemoryBudget;
+@synthesize endpointResponseSizes = _endpointResponseSizes;
+@synthesize hedgeDelay = _hedgeDelay;
+@synthesize adaptiveHedgeDelay = _adaptiveHedgeDelay;
+@synthesize hedgeBudget = _hedgeBudget;
+@synthesize endpointLatencies = _endpointLatencies;
+@synthesize hedgeTokens = _hedgeTokens;
+@synthesize hedgeQueue = _hedgeQueue;
+@synthesize enableCircuitBreakers = _enableCircuitBreakers;
+@synthesize circuitBreakerFailureRateThreshold = _circuitBreakerFailureRateThreshold;
+@synthesize circuitBreakerMinimumNumOfRequests = _circuitBreakerMinimumNumOfRequests;
+@synthesize circuitBreakerSlowResponseThreshold = _circuitBreakerSlowResponseThreshold;
+@synthesize circuitBreakerOpenDuration = _circuitBreakerOpenDuration;
+@synthesize circuitBreakers = _circuitBreakers;
 
 #pragma mark - Initialization
 - (id)init {
@@ -85,10 +120,41 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
         _suspendRequestsWhenAppEntersBackground = YES;
         _enableHttpPipeling = YES;
         _supportLocalTestData = NO;
+        _transportMode = SFNetworkTransportModeLive;
+        //MKNetworkOperation isEqual: compares unique identifiers, key internal operations by identity instead
+        _operationsBeingRecorded = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality
+                                                             valueOptions:NSPointerFunctionsStrongMemory
+                                                                 capacity:0];
+        _replayQueue = [[NSOperationQueue alloc] init];
         _operationsWaitingForAccessToken = [[NSMutableArray alloc] init];
         
         _operationsWaitingForNetwork = [[NSMutableArray alloc] init];
         
+        _maximumInFlightBytes = 0;
+        _spillThresholdBytes = 0;
+        _operationsWaitingForMemoryBudget = [[NSMutableArray alloc] init];
+        _operationsChargedToMemoryBudget = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality
+                                                                     valueOptions:NSPointerFunctionsStrongMemory
+                                                                         capacity:0];
+        _endpointResponseSizes = [[NSMutableDictionary alloc] init];
+        
+        //Temporary files spilled by a previous run of the app are never read again
+        [SFNetworkOperation deleteSpilledResponseFilesCreatedBefore:[NSDate date]];
+        
+        _hedgeDelay = kDefaultHedgeDelay;
+        _adaptiveHedgeDelay = YES;
+        _hedgeBudget = kDefaultHedgeBudget;
+        _endpointLatencies = [[NSMutableDictionary alloc] init];
+        _hedgeQueue = [[NSOperationQueue alloc] init];
+        _hedgeQueue.maxConcurrentOperationCount = kMaximumConcurrentHedges;
+        
+        _enableCircuitBreakers = NO;
+        _circuitBreakerFailureRateThreshold = kDefaultCircuitBreakerFailureRateThreshold;
+        _circuitBreakerMinimumNumOfRequests = kDefaultCircuitBreakerMinimumNumOfRequests;
+        _circuitBreakerSlowResponseThreshold = 0;
+        _circuitBreakerOpenDuration = kDefaultCircuitBreakerOpenDuration;
+        _circuitBreakers = [[NSMutableDictionary alloc] init];
+        
         //Monitor application enters and exist background
         [[NSNotificationCenter defaultCenter] addObserver:self
                                                  selector:@selector(appEnteredBackground:)
@@ -122,6 +188,13 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
         _networkChangeShouldTriggerTokenRefresh = NO;
         _coordinator = nil;
         [self.operationsWaitingForAccessToken removeAllObjects];
+        [self.operationsWaitingForMemoryBudget removeAllObjects];
+        [self.endpointResponseSizes removeAllObjects];
+        [self.endpointLatencies removeAllObjects];
+        _hedgeTokens = 0;
+        [self.hedgeQueue cancelAllOperations];
+        [self.replayQueue cancelAllOperations];
+        [self.circuitBreakers removeAllObjects];
         
         // Only if we have a internal Network Engine
         if(_internalNetworkEngine) {
@@ -331,19 +404,109 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
     //add no cache header Cache-control: no-cache, no-store
     [operation setHeaderValue:@"no-cache, no-store" forKey:@"Cache-control"];
     
+    //Handle record & replay mode
+    if (self.transportMode == SFNetworkTransportModeReplay) {
+        [self replayOperation:operation];
+        return;
+    }
+    operation.replayedResponse = nil;
+    
+    //Fail fast if the endpoint keeps failing. Operations retried after a connectivity error were already admitted before the device went offline
+    NSUInteger probeToken = 0;
+    BOOL checkCircuitBreaker = self.enableCircuitBreakers && !operation.bypassCircuitBreaker;
+    operation.bypassCircuitBreaker = NO;
+    if (checkCircuitBreaker && ![[self circuitBreakerForURL:operation.url] allowRequestWithProbeToken:&probeToken]) {
+        [self log:SFLogLevelInfo format:@"Circuit breaker open, failing %@", operation];
+        NSError *error = [NSError errorWithDomain:kSFNetworkErrorDomain code:kSFNetworkErrorCodeCircuitOpen userInfo:@{NSURLErrorFailingURLStringErrorKey : operation.url}];
+        __weak SFNetworkEngine *weakSelf = self;
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [weakSelf failOperation:operation withError:error];
+        });
+        return;
+    }
+    operation.circuitBreakerProbeToken = probeToken;
+    
+    //Write large response to a temporary file instead of memory. The temporary file is not encrypted, only spill when the caller opted out of encryption
+    if (self.spillThresholdBytes > 0 && self.transportMode != SFNetworkTransportModeRecord && nil == operation.pathToStoreDownloadedContent
+        && !operation.encryptDownloadedFile && [self expectedDownloadSizeForOperation:operation] > self.spillThresholdBytes) {
+        [operation spillResponseToTemporaryFile];
+    }
+    
+    if (![self admitOperationWithinMemoryBudget:operation]) {
+        return;
+    }
+    [self startOperation:operation];
+}
+
+- (void)startOperation:(SFNetworkOperation *)operation {
+    MKNetworkOperation *internalOperation = operation.internalOperation;
+    if (self.transportMode == SFNetworkTransportModeRecord) {
+        [self startRecordingOperation:operation];
+    }
+    
+    __weak SFNetworkEngine *weakSelf = self;
+    if (self.maximumInFlightBytes > 0) {
+        //Budget is released when the operation finishes, start whatever now fits
+        [internalOperation addCompletionHandler:^(MKNetworkOperation *completedOperation) {
+            [weakSelf startOperationsWaitingForMemoryBudget];
+        } errorHandler:^(MKNetworkOperation *completedOperation, NSError *error) {
+            [weakSelf startOperationsWaitingForMemoryBudget];
+        }];
+    }
+    if (self.maximumInFlightBytes > 0 || self.spillThresholdBytes > 0) {
+        //Download progress is first reported once the response headers, and so the actual content length, are received
+        __weak MKNetworkOperation *weakInternalOperation = internalOperation;
+        NSString *url = operation.url;
+        __block BOOL contentLengthReceived = NO;
+        [internalOperation onDownloadProgressChanged:^(double progress) {
+            if (contentLengthReceived) {
+                return;
+            }
+            contentLengthReceived = YES;
+            [weakSelf updateChargeOfOperation:weakInternalOperation forURL:url];
+        }];
+    }
+    
+    if (self.transportMode == SFNetworkTransportModeLive) {
+        [self scheduleHedgeForOperation:operation];
+    } else {
+        operation.hedge = nil;
+    }
+    [self observeStartOfOperation:operation];
+    [self trackResponseOfOperation:operation];
+    
     MKNetworkEngine *engine = [self internalNetworkEngine];
-    [engine enqueueOperation:operation.internalOperation forceReload:YES];
+    [engine enqueueOperation:internalOperation forceReload:YES];
+    
+    //Internal engine merges an operation into a queued one with the same unique identifier, in which case it is never started
+    //and should not hold any memory budget
+    if (self.maximumInFlightBytes > 0 && !internalOperation.isExecuting && !internalOperation.isFinished && NSNotFound == [[engine operations] indexOfObjectIdenticalTo:internalOperation]) {
+        @synchronized(self) {
+            [self.operationsChargedToMemoryBudget removeObjectForKey:internalOperation];
+        }
+        [self startOperationsWaitingForMemoryBudget];
+    }
 }
 
 - (void)cancelAllOperations {
     if (nil != _internalNetworkEngine) {
         [_internalNetworkEngine cancelAllOperations];
     }
+    [self.hedgeQueue cancelAllOperations];
+    [self.replayQueue cancelAllOperations];
+    NSArray *safeCopy = nil;
+    @synchronized(self) {
+        safeCopy = [self.operationsWaitingForMemoryBudget copy];
+        [self.operationsWaitingForMemoryBudget removeAllObjects];
+    }
+    for (SFNetworkOperation *operation in safeCopy) {
+        [operation.internalOperation cancel];
+    }
     [[NSNotificationCenter defaultCenter] postNotificationName:SFNetworkOperationEngineOperationCancelledNotification object:nil userInfo:nil];
 }
 
 - (void)cancelAllOperationsWithTag:(NSString *)operationTag {
-    if (nil == operationTag || nil == _internalNetworkEngine) {
+    if (nil == operationTag) {
         return;
     }
 //    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"tag = %@", operationTag];
@@ -355,9 +518,37 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
             [operation cancel];
         }
     }
+    
+    //Duplicate requests of hedged operations carry the tag of their original request
+    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"tag = %@", operationTag];
+    for (MKNetworkOperation *hedgeOperation in [[self.hedgeQueue operations] filteredArrayUsingPredicate:predicate]) {
+        if (!hedgeOperation.isFinished) {
+            [hedgeOperation cancel];
+        }
+    }
+    
+    //Operations waiting for memory budget have not reached the internal network engine yet
+    NSMutableArray *waitingOperations = [NSMutableArray array];
+    @synchronized(self) {
+        for (SFNetworkOperation *operation in self.operationsWaitingForMemoryBudget) {
+            if ([operation.tag isEqualToString:operationTag]) {
+                [waitingOperations addObject:operation];
+            }
+        }
+        [self.operationsWaitingForMemoryBudget removeObjectsInArray:waitingOperations];
+    }
+    for (SFNetworkOperation *operation in waitingOperations) {
+        [operation.internalOperation cancel];
+    }
+    
+    //Cancelled operations do not call their handlers, release the memory budget they held
+    [self startOperationsWaitingForMemoryBudget];
 }
 
 - (NSArray *)operationsWithTag:(NSString *)operationTag {
+    if (nil == _internalNetworkEngine) {
+        return [NSArray array];
+    }
     NSPredicate *predicate = [NSPredicate predicateWithFormat:@"tag = %@", operationTag];
     NSArray *operations = [[_internalNetworkEngine operations] filteredArrayUsingPredicate:predicate];
     NSMutableArray *pendingOperations = [NSMutableArray arrayWithCapacity:operations.count];
@@ -375,6 +566,7 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
     if (nil != _internalNetworkEngine) {
         [_internalNetworkEngine suspendAllOperations];
     }
+    [self.hedgeQueue setSuspended:YES];
     [[NSNotificationCenter defaultCenter] postNotificationName:SFNetworkOperationEngineSuspendedNotification object:nil userInfo:nil];
 }
 
@@ -382,6 +574,7 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
     if (nil != _internalNetworkEngine) {
         [_internalNetworkEngine resumeAllOperations];
     }
+    [self.hedgeQueue setSuspended:NO];
     [[NSNotificationCenter defaultCenter] postNotificationName:SFNetworkOperationEngineResumedNotification object:nil userInfo:nil];
 }
 
@@ -567,22 +760,29 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
     }
     
     for (SFNetworkOperation *operation in safeCopy) {
-        MKNetworkOperation *internalOperation = operation.internalOperation;
-        NSArray *errorBlocks = [internalOperation errorBlocksType2];
-        for (MKNKResponseErrorBlock errorBlock in errorBlocks) {
-            errorBlock(internalOperation, error);
-        }
+        [self failOperation:operation withError:error];
+    }
+}
+
+- (void)failOperation:(SFNetworkOperation *)operation withError:(NSError *)error {
+    MKNetworkOperation *internalOperation = operation.internalOperation;
+    NSArray *errorBlocks = [internalOperation errorBlocksType2];
+    for (MKNKResponseErrorBlock errorBlock in errorBlocks) {
+        errorBlock(internalOperation, error);
     }
 }
 
 #pragma mark - Queue and Replay for Network 
-- (void)queueOperationOnNetworkError:(SFNetworkOperation *)operation {
+- (void)queueOperationOnNetworkError:(SFNetworkOperation *)operation error:(NSError *)error {
     if (nil == operation) {
         return;
     }
     
     SFNetworkOperation *newOperation = [self cloneInternalOperation:operation];
     if (newOperation) {
+        //Retry after a connectivity error was admitted before the device went offline. A time out counts against the endpoint,
+        //retrying it should not bypass the breaker it may have just opened
+        newOperation.bypassCircuitBreaker = ![self isEndpointFailure:error];
         @synchronized(self) {
             [self.operationsWaitingForNetwork addObject:newOperation];
         }
@@ -632,6 +832,347 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
     return NO;
 }
 
+#pragma mark - Memory Budget
+- (NSUInteger)postedBytesForOperation:(MKNetworkOperation *)internalOperation {
+    NSUInteger bytes = 0;
+    for (NSDictionary *fileDict in internalOperation.dataToBePosted) {
+        bytes += [[fileDict objectForKey:@"data"] length];
+    }
+    return bytes;
+}
+
+- (NSUInteger)expectedDownloadSizeForOperation:(SFNetworkOperation *)operation {
+    if (operation.expectedDownloadSize > 0) {
+        return operation.expectedDownloadSize;
+    }
+    NSString *endpointKey = [self endpointKeyForURL:operation.url];
+    @synchronized(self) {
+        return [self.endpointResponseSizes[endpointKey] unsignedIntegerValue];
+    }
+}
+
+- (NSUInteger)bufferedBytesForOperation:(SFNetworkOperation *)operation {
+    MKNetworkOperation *internalOperation = operation.internalOperation;
+    NSUInteger bytes = [self postedBytesForOperation:internalOperation];
+    if (nil == internalOperation.downloadFile) {
+        bytes += [self expectedDownloadSizeForOperation:operation];
+    }
+    return bytes;
+}
+
+- (void)updateChargeOfOperation:(MKNetworkOperation *)internalOperation forURL:(NSString *)url {
+    long long contentLength = [[internalOperation readonlyResponse] expectedContentLength];
+    if (nil == internalOperation || contentLength <= 0) {
+        //NSURLResponseUnknownLength, keep the estimate
+        return;
+    }
+    NSUInteger responseSize = (NSUInteger)MIN(contentLength, (long long)NSUIntegerMax);
+    NSString *endpointKey = [self endpointKeyForURL:url];
+    
+    BOOL chargeReduced = NO;
+    @synchronized(self) {
+        if (endpointKey) {
+            self.endpointResponseSizes[endpointKey] = @(responseSize);
+        }
+        NSNumber *charge = [self.operationsChargedToMemoryBudget objectForKey:internalOperation];
+        if (nil != charge && nil == internalOperation.downloadFile) {
+            NSUInteger bytes = [self postedBytesForOperation:internalOperation] + responseSize;
+            chargeReduced = bytes < [charge unsignedIntegerValue];
+            [self.operationsChargedToMemoryBudget setObject:@(bytes) forKey:internalOperation];
+        }
+    }
+    if (chargeReduced) {
+        [self startOperationsWaitingForMemoryBudget];
+    }
+}
+
+- (NSUInteger)inFlightBytes {
+    NSUInteger bytes = 0;
+    @synchronized(self) {
+        NSMutableArray *finishedOperations = [NSMutableArray array];
+        for (MKNetworkOperation *internalOperation in self.operationsChargedToMemoryBudget) {
+            if (internalOperation.isFinished || internalOperation.isCancelled) {
+                [finishedOperations addObject:internalOperation];
+            } else {
+                bytes += [[self.operationsChargedToMemoryBudget objectForKey:internalOperation] unsignedIntegerValue];
+            }
+        }
+        for (MKNetworkOperation *internalOperation in finishedOperations) {
+            [self.operationsChargedToMemoryBudget removeObjectForKey:internalOperation];
+        }
+    }
+    return bytes;
+}
+
+- (BOOL)admitOperationWithinMemoryBudget:(SFNetworkOperation *)operation {
+    if (self.maximumInFlightBytes == 0) {
+        return YES;
+    }
+    
+    NSUInteger bytes = [self bufferedBytesForOperation:operation];
+    @synchronized(self) {
+        NSUInteger inFlightBytes = [self inFlightBytes];
+        if (self.operationsWaitingForMemoryBudget.count == 0 && (inFlightBytes == 0 || inFlightBytes + bytes <= self.maximumInFlightBytes)) {
+            [self.operationsChargedToMemoryBudget setObject:@(bytes) forKey:operation.internalOperation];
+            return YES;
+        }
+        
+        //Keep operations in order, do not let a small operation overtake one that is already waiting
+        [self log:SFLogLevelInfo format:@"Memory budget exceeded, %@ will wait for %lu bytes", operation, (unsigned long)bytes];
+        [self.operationsWaitingForMemoryBudget addObject:operation];
+    }
+    
+    //Budget may have been released without any handler being called, e.g. by cancelled operations
+    [self startOperationsWaitingForMemoryBudget];
+    return NO;
+}
+
+- (void)startOperationsWaitingForMemoryBudget {
+    NSMutableArray *admittedOperations = [NSMutableArray array];
+    @synchronized(self) {
+        NSUInteger inFlightBytes = [self inFlightBytes];
+        while (self.operationsWaitingForMemoryBudget.count > 0) {
+            SFNetworkOperation *operation = [self.operationsWaitingForMemoryBudget objectAtIndex:0];
+            if (operation.internalOperation.isCancelled) {
+                [self.operationsWaitingForMemoryBudget removeObjectAtIndex:0];
+                continue;
+            }
+            NSUInteger bytes = [self bufferedBytesForOperation:operation];
+            if (inFlightBytes > 0 && inFlightBytes + bytes > self.maximumInFlightBytes) {
+                break;
+            }
+            inFlightBytes += bytes;
+            [self.operationsChargedToMemoryBudget setObject:@(bytes) forKey:operation.internalOperation];
+            [self.operationsWaitingForMemoryBudget removeObjectAtIndex:0];
+            [admittedOperations addObject:operation];
+        }
+    }
+    
+    for (SFNetworkOperation *operation in admittedOperations) {
+        [self startOperation:operation];
+    }
+}
+
+#pragma mark - Hedging
+- (NSString *)endpointKeyForURL:(NSString *)url {
+    NSURL *endpointURL = [NSURL URLWithString:url];
+    if (nil == endpointURL) {
+        return url;
+    }
+    
+    //Replace record IDs and numbers in the path so that requests to the same resource type share one key
+    static NSRegularExpression *idExpression = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        idExpression = [NSRegularExpression regularExpressionWithPattern:@"^([0-9]+|(?=[A-Za-z]*[0-9])[A-Za-z0-9]{15}([A-Za-z0-9]{3})?)$" options:0 error:nil];
+    });
+    NSMutableArray *templateComponents = [NSMutableArray array];
+    for (NSString *component in [endpointURL.path componentsSeparatedByString:@"/"]) {
+        if ([idExpression numberOfMatchesInString:component options:0 range:NSMakeRange(0, component.length)] > 0) {
+            [templateComponents addObject:kEndpointIdPlaceholder];
+        } else {
+            [templateComponents addObject:component];
+        }
+    }
+    return [NSString stringWithFormat:@"%@%@", endpointURL.host, [templateComponents componentsJoinedByString:@"/"]];
+}
+
+- (void)recordLatency:(NSTimeInterval)latency forEndpoint:(NSString *)endpointKey {
+    if (nil == endpointKey) {
+        return;
+    }
+    @synchronized(self) {
+        NSMutableArray *latencies = self.endpointLatencies[endpointKey];
+        if (nil == latencies) {
+            latencies = [NSMutableArray arrayWithCapacity:kMaximumLatencySamples];
+            self.endpointLatencies[endpointKey] = latencies;
+        }
+        if (latencies.count >= kMaximumLatencySamples) {
+            [latencies removeObjectAtIndex:0];
+        }
+        [latencies addObject:@(latency)];
+    }
+}
+
+- (NSTimeInterval)hedgeDelayForOperation:(SFNetworkOperation *)operation {
+    if (!self.adaptiveHedgeDelay) {
+        return self.hedgeDelay;
+    }
+    NSArray *latencies = nil;
+    @synchronized(self) {
+        latencies = [self.endpointLatencies[[self endpointKeyForURL:operation.url]] copy];
+    }
+    if (latencies.count < kMinimumLatencySamples) {
+        return self.hedgeDelay;
+    }
+    NSArray *sortedLatencies = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger index = (NSUInteger)ceil(kHedgeLatencyPercentile * sortedLatencies.count) - 1;
+    return [sortedLatencies[index] doubleValue];
+}
+
+- (void)scheduleHedgeForOperation:(SFNetworkOperation *)operation {
+    MKNetworkOperation *internalOperation = operation.internalOperation;
+    if (!operation.hedgeOnSlowResponse || ![self isIdempotentOperation:operation] || nil != internalOperation.downloadFile) {
+        operation.hedge = nil;
+        return;
+    }
+    
+    operation.hedge = [[SFNetworkHedge alloc] initWithPrimaryOperation:internalOperation];
+    @synchronized(self) {
+        _hedgeTokens = MIN(_hedgeTokens + self.hedgeBudget, kMaximumHedgeTokens);
+    }
+}
+
+- (void)observeStartOfOperation:(SFNetworkOperation *)operation {
+    SFNetworkHedge *hedge = operation.hedge;
+    BOOL trackSlowResponse = self.enableCircuitBreakers && self.circuitBreakerSlowResponseThreshold > 0;
+    if (nil == hedge && !trackSlowResponse) {
+        operation.startObserver = nil;
+        return;
+    }
+    
+    //Hedge delay and response time count from the time the request is sent, not while it waits for a free connection
+    __weak SFNetworkEngine *weakSelf = self;
+    __weak SFNetworkOperation *weakOperation = operation;
+    operation.startObserver = [[SFNetworkStartObserver alloc] initWithOperation:operation.internalOperation startedHandler:^{
+        if (hedge) {
+            [weakSelf armHedgeForOperation:weakOperation hedge:hedge afterDelay:[weakSelf hedgeDelayForOperation:weakOperation]];
+        }
+    }];
+}
+
+- (void)armHedgeForOperation:(SFNetworkOperation *)operation hedge:(SFNetworkHedge *)hedge afterDelay:(NSTimeInterval)delay {
+    __weak SFNetworkEngine *weakSelf = self;
+    __weak SFNetworkOperation *weakOperation = operation;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [weakSelf startHedgeForOperation:weakOperation hedge:hedge];
+    });
+}
+
+- (void)startHedgeForOperation:(SFNetworkOperation *)operation hedge:(SFNetworkHedge *)hedge {
+    MKNetworkOperation *primaryOperation = hedge.primaryOperation;
+    if (nil == operation || operation.hedge != hedge || nil == primaryOperation || primaryOperation.isFinished || primaryOperation.isCancelled) {
+        return;
+    }
+    
+    MKNetworkOperation *hedgeOperation = [[self internalNetworkEngine] operationWithURLString:operation.url params:primaryOperation.fieldsToBePosted httpMethod:operation.method];
+    hedgeOperation.enableHttpPipelining = self.enableHttpPipeling;
+    hedgeOperation.freezable = NO;
+    hedgeOperation.timeout = operation.operationTimeout;
+    hedgeOperation.cachePolicy = operation.cachePolicy;
+    hedgeOperation.requiresAccessToken = operation.requiresAccessToken;
+    hedgeOperation.tag = primaryOperation.tag;
+    [hedgeOperation setHeaders:operation.customHeaders];
+    [hedgeOperation updateHandlersFromOperation:primaryOperation];
+    
+    @synchronized(self) {
+        if (self.hedgeTokens < 1) {
+            [self log:SFLogLevelInfo format:@"Hedge budget exhausted, not sending duplicate request for %@", operation];
+            return;
+        }
+        NSUInteger bytes = 0;
+        if (self.maximumInFlightBytes > 0) {
+            bytes = [self bufferedBytesForOperation:operation];
+            if ([self inFlightBytes] + bytes > self.maximumInFlightBytes) {
+                [self log:SFLogLevelInfo format:@"Memory budget exceeded, not sending duplicate request for %@", operation];
+                return;
+            }
+        }
+        if (![hedge setHedgeOperationIfUndecided:hedgeOperation]) {
+            return;
+        }
+        _hedgeTokens -= 1;
+        if (self.maximumInFlightBytes > 0) {
+            [self.operationsChargedToMemoryBudget setObject:@(bytes) forKey:hedgeOperation];
+        }
+    }
+    [self log:SFLogLevelInfo format:@"No response after hedge delay, sending duplicate request for %@", operation];
+    [self.hedgeQueue addOperation:hedgeOperation];
+}
+
+- (BOOL)isIdempotentOperation:(SFNetworkOperation *)operation {
+    return [operation.method isEqualToString:SFNetworkOperationGetMethod] || [operation.method isEqualToString:SFNetworkOperationHeadMethod];
+}
+
+#pragma mark - Endpoint Health
+- (void)trackResponseOfOperation:(SFNetworkOperation *)operation {
+    //Latency is only used to compute the adaptive hedge delay, and is measured from the time the hedged request is sent
+    BOOL trackLatency = self.adaptiveHedgeDelay && nil != operation.hedge;
+    BOOL trackHealth = self.enableCircuitBreakers;
+    if (!trackLatency && !trackHealth) {
+        return;
+    }
+    
+    __weak SFNetworkEngine *weakSelf = self;
+    __weak SFNetworkHedge *weakHedge = operation.hedge;
+    __weak SFNetworkStartObserver *weakStartObserver = operation.startObserver;
+    __weak MKNetworkOperation *trackedOperation = operation.internalOperation;
+    NSString *url = operation.url;
+    NSString *endpointKey = [self endpointKeyForURL:url];
+    NSUInteger probeToken = operation.circuitBreakerProbeToken;
+    [operation.internalOperation addCompletionHandler:^(MKNetworkOperation *completedOperation) {
+        //Handlers are copied to clones and duplicate requests, only count the response of this request or its duplicate
+        if (completedOperation != trackedOperation && (nil == weakHedge || completedOperation != weakHedge.hedgeOperation)) {
+            return;
+        }
+        if (trackLatency) {
+            NSTimeInterval startTime = weakStartObserver.startTime;
+            if (startTime > 0) {
+                [weakSelf recordLatency:[NSDate timeIntervalSinceReferenceDate] - startTime forEndpoint:endpointKey];
+            }
+        }
+        if (trackHealth) {
+            NSTimeInterval slowResponseThreshold = weakSelf.circuitBreakerSlowResponseThreshold;
+            NSTimeInterval startTime = weakStartObserver.startTime;
+            BOOL slow = slowResponseThreshold > 0 && startTime > 0 && [NSDate timeIntervalSinceReferenceDate] - startTime > slowResponseThreshold;
+            [[weakSelf circuitBreakerForURL:url] recordRequestSucceeded:!slow probeToken:probeToken];
+        }
+    } errorHandler:^(MKNetworkOperation *completedOperation, NSError *error) {
+        if (completedOperation != trackedOperation && (nil == weakHedge || completedOperation != weakHedge.hedgeOperation)) {
+            return;
+        }
+        if (trackHealth) {
+            [[weakSelf circuitBreakerForURL:url] recordRequestSucceeded:![weakSelf isEndpointFailure:error] probeToken:probeToken];
+        }
+    }];
+}
+
+- (BOOL)isEndpointFailure:(NSError *)error {
+    switch ([SFNetworkUtils typeOfError:error]) {
+        case SFNetworkOperationErrorTypeInternalServerError:
+        case SFNetworkOperationErrorTypeAPILimitReached:
+            return YES;
+        case SFNetworkOperationErrorTypeNetworkError:
+            //Other network errors mean the device is offline, not that the endpoint is unhealthy
+            return error.code == kCFURLErrorTimedOut && [self isReachable];
+        default:
+            return NO;
+    }
+}
+
+- (SFNetworkCircuitBreaker *)circuitBreakerForURL:(NSString *)url {
+    NSString *endpointKey = [self endpointKeyForURL:url];
+    if (nil == endpointKey) {
+        return nil;
+    }
+    @synchronized(self) {
+        SFNetworkCircuitBreaker *circuitBreaker = self.circuitBreakers[endpointKey];
+        if (nil == circuitBreaker) {
+            circuitBreaker = [[SFNetworkCircuitBreaker alloc] initWithEndpointKey:endpointKey
+                                                             failureRateThreshold:self.circuitBreakerFailureRateThreshold
+                                                             minimumNumOfRequests:self.circuitBreakerMinimumNumOfRequests
+                                                                     openDuration:self.circuitBreakerOpenDuration];
+            circuitBreaker.stateChangedHandler = ^(SFNetworkCircuitBreaker *changedCircuitBreaker, SFNetworkCircuitBreakerState state) {
+                [[NSNotificationCenter defaultCenter] postNotificationName:SFNetworkOperationCircuitBreakerStateChangedNotification
+                                                                    object:[NSNumber numberWithInt:state]
+                                                                  userInfo:@{SFNetworkCircuitBreakerEndpointKey : changedCircuitBreaker.endpointKey}];
+            };
+            self.circuitBreakers[endpointKey] = circuitBreaker;
+        }
+        return circuitBreaker;
+    }
+}
+
 #pragma mark - Clone Operation
 #pragma mark - Copying Protocol
 - (SFNetworkOperation *)cloneInternalOperation:(SFNetworkOperation *)operation {
@@ -648,6 +1189,7 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
     MKNetworkOperation *newInternalOperation = [[self internalNetworkEngine] operationWithURLString:operation.url params:internalOperation.fieldsToBePosted httpMethod:operation.method];
     newInternalOperation.enableHttpPipelining = self.enableHttpPipeling;
     newInternalOperation.freezable = NO;
+    newInternalOperation.tag = internalOperation.tag;
     [newInternalOperation updateHandlersFromOperation:internalOperation];
     
     //Add file data if exists
@@ -678,8 +1220,122 @@ static NSString * const kAuthoriationHeaderKey = @"Authorization";
     if (![fileManager fileExistsAtPath:localDataFilePath]){
         return nil;
     }
-    NSData *fileData = [NSData dataWithContentsOfFile:localDataFilePath];
+    NSData *fileData = [NSData dataWithContentsOfFile:localDataFilePath options:NSDataReadingMappedIfSafe error:nil];
     
     return fileData;
 }
+
+#pragma mark - Record & Replay Support
+- (void)startRecordingOperation:(SFNetworkOperation *)operation {
+    MKNetworkOperation *internalOperation = operation.internalOperation;
+    @synchronized(self) {
+        if (nil == self.sessionArchive) {
+            self.sessionArchive = [[SFNetworkSessionArchive alloc] init];
+        }
+        [self.operationsBeingRecorded setObject:@([NSDate timeIntervalSinceReferenceDate]) forKey:internalOperation];
+    }
+    
+    __weak SFNetworkEngine *weakSelf = self;
+    [internalOperation addCompletionHandler:^(MKNetworkOperation *completedOperation) {
+        [weakSelf finishRecordingOperation:completedOperation];
+    } errorHandler:^(MKNetworkOperation *completedOperation, NSError *error) {
+        [weakSelf finishRecordingOperation:completedOperation];
+    }];
+}
+
+- (void)finishRecordingOperation:(MKNetworkOperation *)operation {
+    NSNumber *startTime = nil;
+    SFNetworkSessionArchive *archive = nil;
+    @synchronized(self) {
+        //Handlers are copied when an operation is cloned, only the operation that was actually started is recorded
+        startTime = [self.operationsBeingRecorded objectForKey:operation];
+        [self.operationsBeingRecorded removeObjectForKey:operation];
+        archive = self.sessionArchive;
+    }
+    if (nil == startTime || nil == archive) {
+        return;
+    }
+    if (nil == [operation readonlyResponse]) {
+        //Transport failure, e.g. a network error. There is no response to replay
+        [self log:SFLogLevelInfo format:@"Not recording %@, no response was received", operation];
+        return;
+    }
+    
+    NSTimeInterval duration = [NSDate timeIntervalSinceReferenceDate] - [startTime doubleValue];
+    NSData *body = [operation responseData];
+    if (0 == body.length && nil != operation.downloadFile) {
+        //Content stored to a file is not kept in memory, archive it as written to the file
+        body = [NSData dataWithContentsOfFile:operation.downloadFile options:NSDataReadingMappedIfSafe error:nil];
+    }
+    SFNetworkRecordedResponse *response = [[SFNetworkRecordedResponse alloc] initWithRequestKey:[self recordingKeyForOperation:operation]
+                                                                                     statusCode:[operation HTTPStatusCode]
+                                                                                        headers:[[operation readonlyResponse] allHeaderFields]
+                                                                                           body:body
+                                                                                       duration:duration];
+    [archive addResponse:response];
+}
+
+- (NSString *)recordingKeyForOperation:(MKNetworkOperation *)operation {
+    NSString *uniqueIdentifier = [operation uniqueIdentifier];
+    if (0 == operation.fieldsToBePosted.count && 0 == operation.dataToBePosted.count) {
+        return uniqueIdentifier;
+    }
+    
+    CC_SHA1_CTX context;
+    CC_SHA1_Init(&context);
+    NSArray *sortedKeys = [[operation.fieldsToBePosted allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    for (NSString *key in sortedKeys) {
+        NSData *fieldData = [[NSString stringWithFormat:@"%@=%@&", key, [operation.fieldsToBePosted objectForKey:key]] dataUsingEncoding:NSUTF8StringEncoding];
+        CC_SHA1_Update(&context, fieldData.bytes, (CC_LONG)fieldData.length);
+    }
+    for (NSDictionary *fileDict in operation.dataToBePosted) {
+        NSData *nameData = [[NSString stringWithFormat:@"%@;%@;", [fileDict valueForKey:@"name"], [fileDict valueForKey:@"filename"]] dataUsingEncoding:NSUTF8StringEncoding];
+        NSData *fileData = [fileDict objectForKey:@"data"];
+        CC_SHA1_Update(&context, nameData.bytes, (CC_LONG)nameData.length);
+        CC_SHA1_Update(&context, fileData.bytes, (CC_LONG)fileData.length);
+    }
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1_Final(digest, &context);
+    
+    NSMutableString *recordingKey = [NSMutableString stringWithFormat:@"%@ ", uniqueIdentifier];
+    for (NSUInteger i = 0; i < CC_SHA1_DIGEST_LENGTH; i++) {
+        [recordingKey appendFormat:@"%02x", digest[i]];
+    }
+    return recordingKey;
+}
+
+- (void)replayOperation:(SFNetworkOperation *)operation {
+    MKNetworkOperation *internalOperation = operation.internalOperation;
+    SFNetworkSessionArchive *archive = self.sessionArchive;
+    SFNetworkRecordedResponse *response = [archive responseForRequestKey:[self recordingKeyForOperation:internalOperation]];
+    
+    __weak SFNetworkEngine *weakSelf = self;
+    if (nil == response) {
+        [self log:SFLogLevelError format:@"No recorded response to replay for %@", operation.url];
+        NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorFileDoesNotExist userInfo:@{NSURLErrorFailingURLStringErrorKey : operation.url}];
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [weakSelf failOperation:operation withError:error];
+        });
+        return;
+    }
+    
+    operation.replayedResponse = response;
+    NSTimeInterval delay = [archive replayDelayForResponse:response];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        if (internalOperation.isCancelled) {
+            return;
+        }
+        if (response.statusCode >= 400) {
+            //Same error MKNetworkOperation reports for a HTTP error status code. The recorded body is served by the response methods
+            //of SFNetworkOperation, so error blocks can read service errors from it as they would from a live response
+            NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:response.statusCode userInfo:response.headers];
+            [weakSelf failOperation:operation withError:error];
+        } else {
+            //Local test data is served by the internal operation without opening a connection.
+            //Run it on replayQueue so that concurrent operations with the same unique identifier each get their own recorded response
+            [internalOperation setLocalTestData:response.body];
+            [weakSelf.replayQueue addOperation:internalOperation];
+        }
+    });
+}
 @end
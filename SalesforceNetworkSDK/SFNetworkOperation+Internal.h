@@ -8,6 +8,70 @@
 
 #import <Foundation/Foundation.h>
 #import "MKNetworkKit.h"
+#import "SFNetworkSessionArchive.h"
+
+/** Records the time an internal operation starts executing, i.e. when its request is sent rather than while it waits in a queue
+ 
+ The operation is observed with KVO, and kept alive, until it starts executing or finishes
+ */
+@interface SFNetworkStartObserver : NSObject
+
+/** Time the observed operation started executing. 0 until then */
+@property (readonly) NSTimeInterval startTime;
+
+/** Create new SFNetworkStartObserver
+ 
+ @param operation Internal operation to observe
+ @param startedHandler Block invoked once on the thread that starts the operation. Not invoked if the operation finishes without executing, e.g. when it is cancelled while queued
+ */
+- (id)initWithOperation:(MKNetworkOperation *)operation startedHandler:(dispatch_block_t)startedHandler;
+@end
+
+/** Tracks the original and duplicate request of a hedged `SFNetworkOperation`
+ 
+ See `[SFNetworkOperation hedgeOnSlowResponse]` for more details
+ */
+@interface SFNetworkHedge : NSObject
+
+/** Internal operation originally enqueued */
+@property (nonatomic, readonly, weak) MKNetworkOperation *primaryOperation;
+
+/** Duplicate internal operation. nil until the duplicate request is started */
+@property (nonatomic, readonly, strong) MKNetworkOperation *hedgeOperation;
+
+/** Internal operation whose result is delivered to the caller. nil until one of the requests finishes */
+@property (nonatomic, readonly, strong) MKNetworkOperation *winningOperation;
+
+/** Create new SFNetworkHedge
+ 
+ @param primaryOperation Internal operation originally enqueued
+ */
+- (id)initWithPrimaryOperation:(MKNetworkOperation *)primaryOperation;
+
+/** Set the duplicate internal operation
+ 
+ Returns NO if a result has already been delivered, in which case the duplicate request should not be started
+ 
+ @param hedgeOperation Duplicate internal operation
+ */
+- (BOOL)setHedgeOperationIfUndecided:(MKNetworkOperation *)hedgeOperation;
+
+/** Return YES if the result of the specified internal operation should be delivered to the caller
+ 
+ A successful result is delivered if no result has been delivered yet, and the other request is cancelled.
+ A failed result is held back while the other request is executing, and delivered only if the other request fails too. If the other request
+ has not been sent yet, it is cancelled and the failed result is delivered right away
+ Returns the same value when called again for the same operation
+ 
+ @param operation Internal operation that finished
+ @param succeeded YES if the operation completed, NO if it failed
+ */
+- (BOOL)shouldDeliverResultOfOperation:(MKNetworkOperation *)operation succeeded:(BOOL)succeeded;
+
+/** Cancel the duplicate request if started
+ */
+- (void)cancel;
+@end
 
 @interface SFNetworkOperation ()
 
@@ -27,6 +91,56 @@
  */
 @property (nonatomic, assign) NSUInteger numOfRetriesForNetworkError;
 
+/** Recorded response served to this operation when `[SFNetworkEngine transportMode]` is `SFNetworkTransportModeReplay`
+ 
+ When set, `statusCode`, `responseHeaders` and the response body returned by the response methods are read from this response instead of
+ from `internalOperation`. Recorded error responses are not run by `internalOperation`, this is how their body reaches the error blocks
+ */
+@property (nonatomic, strong) SFNetworkRecordedResponse *replayedResponse;
+
+/** Records when the current internal operation is sent. nil if the start time is not needed
+ 
+ See `[SFNetworkEngine observeStartOfOperation:]`
+ */
+@property (strong) SFNetworkStartObserver *startObserver;
+
+/** Hedge of the current internal operation. nil if this operation is not hedged
+ 
+ See `hedgeOnSlowResponse` for more details
+ */
+@property (strong) SFNetworkHedge *hedge;
+
+/** Return YES if the result of the specified internal operation should be delivered to completion and error blocks and delegate
+ 
+ Always returns YES if `hedge` is nil. See `[SFNetworkHedge shouldDeliverResultOfOperation:succeeded:]`
+ 
+ @param operation Internal operation that finished
+ @param succeeded YES if the operation completed, NO if it failed
+ */
+- (BOOL)shouldDeliverResultOfOperation:(MKNetworkOperation *)operation succeeded:(BOOL)succeeded;
+
+/** YES if this operation was queued by `[SFNetworkEngine queueOperationOnNetworkError:error:]` after a connectivity error
+ 
+ The next `[SFNetworkEngine enqueueOperation:]` of such operation is not failed by an open circuit breaker, and resets this flag
+ */
+@property (nonatomic, assign) BOOL bypassCircuitBreaker;
+
+/** Token returned by `[SFNetworkCircuitBreaker allowRequestWithProbeToken:]` when this operation was admitted. 0 if it is not a probe request
+ */
+@property (nonatomic, assign) NSUInteger circuitBreakerProbeToken;
+
+/** Path of the temporary file the response is written to instead of memory
+ 
+ See `[SFNetworkEngine spillThresholdBytes]` for more details
+ */
+@property (nonatomic, readonly, copy) NSString *spilledResponsePath;
+
+/** Write response of this operation to a temporary file instead of memory
+ 
+ Creates `spilledResponsePath` if needed and applies it to `internalOperation`. Calling this method again after `internalOperation` is replaced re-applies the same path
+ */
+- (void)spillResponseToTemporaryFile;
+
 /**Create new SFNetworkOperation
  
  @param operation MKNetworkOperation object. Class for handling the low level network calls
@@ -69,6 +183,15 @@
  */
 - (BOOL)shouldRetryOperation:(SFNetworkOperation *)operation onNetworkError:(NSError *)error;
 
+/** Delete temporary files written by `spillResponseToTemporaryFile` that were created before the specified date
+ 
+ Files are deleted in the background. Temporary files of operations that are deallocated are deleted by the operation itself,
+ this removes the files left over when the app was terminated while they were in use
+ 
+ @param date Files created at or after this date are kept
+ */
++ (void)deleteSpilledResponseFilesCreatedBefore:(NSDate *)date;
+
 /** Delete unfinished download file for the specific operation
  
  @param operation Operation that creates the download file
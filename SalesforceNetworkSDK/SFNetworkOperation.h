@@ -66,6 +66,15 @@ typedef NSString* (^SFNetworkOperationEncodingBlock) (NSDictionary* postDataDict
  */
 @property (nonatomic, assign) NSUInteger maximumNumOfRetriesForNetworkError;
 
+/** Set to YES to allow `SFNetworkEngine` to send a duplicate request when no response is received in time. Default value is NO
+ 
+ Only applies to `SFNetworkOperationGetMethod` and `SFNetworkOperationHeadMethod` operations that do not set `pathToStoreDownloadedContent`.
+ If the operation has not finished `[SFNetworkEngine hedgeDelay]` after its request was sent, or the observed 95th percentile latency of the same endpoint
+ when `[SFNetworkEngine adaptiveHedgeDelay]` is YES, a duplicate request is sent. The first successful response is used and the other request
+ is cancelled. Completion and error blocks are still invoked only once. See `[SFNetworkEngine hedgeBudget]` to limit the extra load
+ */
+@property (nonatomic, assign) BOOL hedgeOnSlowResponse;
+
 /** Set this property to enable SFNetworkOperation to read test data from a local file
  
  This feature is useful to simulate server side response using a local mock up data file for testing purpose.
@@ -13,6 +13,166 @@
 #import "SFNetworkUtils.h"
 
 static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
+static NSString *kSpilledResponseFilePrefix = @"SFNetworkOperationResponse-";
+static NSString * const kExecutingKeyPath = @"isExecuting";
+static NSString * const kFinishedKeyPath = @"isFinished";
+
+@interface SFNetworkOperation ()
+
+/** Memory-mapped content of `spilledResponsePath`, read on first access once the operation is finished */
+@property (nonatomic, strong) NSData *spilledResponseData;
+
+/** Return the response string passed to `checkForErrorInResponseStr:withError:`
+ 
+ The check only needs the first character to tell whether the response is JSON, and reads the JSON itself with `responseAsJSON`.
+ A spilled response is therefore not decoded into a string, only its first non-whitespace character is returned
+ */
+- (NSString *)responseStringForErrorCheck;
+
+/** Return the first non-whitespace character of the specified data, or 0 if there is none
+ 
+ @param data Response data
+ */
++ (char)firstNonWhitespaceCharacterOfData:(NSData *)data;
+@end
+
+@interface SFNetworkStartObserver ()
+@property (readwrite) NSTimeInterval startTime;
+
+/** Operation being observed. nil once it started or finished */
+@property (nonatomic, strong) MKNetworkOperation *observedOperation;
+@property (nonatomic, copy) dispatch_block_t startedHandler;
+@end
+
+@interface SFNetworkHedge ()
+@property (nonatomic, readwrite, weak) MKNetworkOperation *primaryOperation;
+@property (nonatomic, readwrite, strong) MKNetworkOperation *hedgeOperation;
+@property (nonatomic, readwrite, strong) MKNetworkOperation *winningOperation;
+
+/** Operations that failed while the other request was still running */
+@property (nonatomic, strong) NSMutableSet *failedOperations;
+@end
+
+@implementation SFNetworkStartObserver
+@synthesize startTime = _startTime;
+@synthesize observedOperation = _observedOperation;
+@synthesize startedHandler = _startedHandler;
+
+- (id)initWithOperation:(MKNetworkOperation *)operation startedHandler:(dispatch_block_t)startedHandler {
+    self = [super init];
+    if (self) {
+        _observedOperation = operation;
+        _startedHandler = [startedHandler copy];
+        
+        //Initial notification covers an operation that is already executing or finished
+        [operation addObserver:self forKeyPath:kFinishedKeyPath options:0 context:NULL];
+        [operation addObserver:self forKeyPath:kExecutingKeyPath options:NSKeyValueObservingOptionInitial context:NULL];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_observedOperation) {
+        [_observedOperation removeObserver:self forKeyPath:kExecutingKeyPath];
+        [_observedOperation removeObserver:self forKeyPath:kFinishedKeyPath];
+    }
+}
+
+- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context {
+    MKNetworkOperation *operation = (MKNetworkOperation *)object;
+    BOOL executing = operation.isExecuting;
+    if (!executing && !operation.isFinished) {
+        return;
+    }
+    
+    dispatch_block_t startedHandler = nil;
+    @synchronized(self) {
+        if (self.observedOperation != operation) {
+            //Already stopped observing
+            return;
+        }
+        self.observedOperation = nil;
+        if (executing) {
+            self.startTime = [NSDate timeIntervalSinceReferenceDate];
+            startedHandler = self.startedHandler;
+        }
+        self.startedHandler = nil;
+    }
+    [operation removeObserver:self forKeyPath:kExecutingKeyPath];
+    [operation removeObserver:self forKeyPath:kFinishedKeyPath];
+    if (startedHandler) {
+        startedHandler();
+    }
+}
+@end
+
+@implementation SFNetworkHedge
+@synthesize primaryOperation = _primaryOperation;
+@synthesize hedgeOperation = _hedgeOperation;
+@synthesize winningOperation = _winningOperation;
+@synthesize failedOperations = _failedOperations;
+
+- (id)initWithPrimaryOperation:(MKNetworkOperation *)primaryOperation {
+    self = [super init];
+    if (self) {
+        _primaryOperation = primaryOperation;
+        _failedOperations = [[NSMutableSet alloc] init];
+    }
+    return self;
+}
+
+- (BOOL)setHedgeOperationIfUndecided:(MKNetworkOperation *)hedgeOperation {
+    @synchronized(self) {
+        if (self.winningOperation || self.failedOperations.count > 0 || self.hedgeOperation) {
+            return NO;
+        }
+        self.hedgeOperation = hedgeOperation;
+        return YES;
+    }
+}
+
+- (BOOL)shouldDeliverResultOfOperation:(MKNetworkOperation *)operation succeeded:(BOOL)succeeded {
+    MKNetworkOperation *operationToCancel = nil;
+    @synchronized(self) {
+        if (operation != self.primaryOperation && operation != self.hedgeOperation) {
+            //Operation cloned from this one for retry, not part of this hedge
+            return YES;
+        }
+        if (self.winningOperation) {
+            return self.winningOperation == operation;
+        }
+        MKNetworkOperation *otherOperation = (operation == self.hedgeOperation) ? self.primaryOperation : self.hedgeOperation;
+        if (!succeeded && nil != otherOperation && ![self.failedOperations containsObject:otherOperation]) {
+            //A finished request reports its result shortly, wait for it too
+            BOOL otherOperationSent = !otherOperation.isCancelled && (otherOperation.isExecuting || otherOperation.isFinished);
+            if (otherOperationSent) {
+                [self.failedOperations addObject:operation];
+                return NO;
+            }
+            //The other request is still queued and would only add to the wait
+            operationToCancel = otherOperation;
+        }
+        self.winningOperation = operation;
+        if (succeeded) {
+            operationToCancel = otherOperation;
+        }
+    }
+    if (operationToCancel && !operationToCancel.isFinished) {
+        [operationToCancel cancel];
+    }
+    return YES;
+}
+
+- (void)cancel {
+    MKNetworkOperation *hedgeOperation = nil;
+    @synchronized(self) {
+        hedgeOperation = self.hedgeOperation;
+    }
+    if (hedgeOperation && !hedgeOperation.isFinished) {
+        [hedgeOperation cancel];
+    }
+}
+@end
 
 @implementation SFNetworkOperation
 @synthesize tag = _tag;
@@ -35,6 +195,14 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
 @synthesize internalOperation = _internalOperation;
 @synthesize cancelBlocks = _cancelBlocks;
 @synthesize retryOnNetworkError = _retryOnNetworkError;
+@synthesize replayedResponse = _replayedResponse;
+@synthesize spilledResponsePath = _spilledResponsePath;
+@synthesize spilledResponseData = _spilledResponseData;
+@synthesize hedgeOnSlowResponse = _hedgeOnSlowResponse;
+@synthesize hedge = _hedge;
+@synthesize startObserver = _startObserver;
+@synthesize bypassCircuitBreaker = _bypassCircuitBreaker;
+@synthesize circuitBreakerProbeToken = _circuitBreakerProbeToken;
 
 #pragma mark - Initialize Method
 - (id)initWithOperation:(MKNetworkOperation *)operation url:(NSString *)url method:(NSString *)method ssl:(BOOL)useSSL {
@@ -54,9 +222,13 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
         
         __weak SFNetworkOperation *weakSelf = self;
         [_internalOperation addCompletionHandler:^(MKNetworkOperation *completedOperation) {
-            [weakSelf callDelegateDidFinish:completedOperation];
+            if ([weakSelf shouldDeliverResultOfOperation:completedOperation succeeded:YES]) {
+                [weakSelf callDelegateDidFinish:completedOperation];
+            }
         } errorHandler:^(MKNetworkOperation *operation, NSError *error) {
-            [weakSelf callDelegateDidFailWithError:error];
+            if ([weakSelf shouldDeliverResultOfOperation:operation succeeded:NO]) {
+                [weakSelf callDelegateDidFailWithError:error];
+            }
         }];
     }
     return self;
@@ -65,6 +237,10 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
 - (void)dealloc {
     self.internalOperation = nil;
     self.delegate = nil;
+    
+    if (_spilledResponsePath) {
+        [[NSFileManager defaultManager] removeItemAtPath:_spilledResponsePath error:nil];
+    }
 }
 
 - (void)setHeaderValue:(NSString *)value forKey:(NSString *)key {
@@ -114,6 +290,9 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
     }
 }
 - (NSInteger)statusCode {
+    if (_replayedResponse) {
+        return _replayedResponse.statusCode;
+    }
     if (_internalOperation) {
         return [_internalOperation HTTPStatusCode];
     }
@@ -137,6 +316,12 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
         return [super description];
     }
 }
+- (void)setTag:(NSString *)tag {
+    _tag = [tag copy];
+    if (_internalOperation) {
+        _internalOperation.tag = tag;
+    }
+}
 - (void)setOperationTimeout:(NSTimeInterval)operationTimeout {
     _operationTimeout = operationTimeout;
     if (_internalOperation) {
@@ -151,6 +336,9 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
 }
 
 - (NSDictionary*)responseHeaders {
+    if (_replayedResponse) {
+        return _replayedResponse.headers;
+    }
     return _internalOperation.cacheHeaders;
 }
 
@@ -167,6 +355,25 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
     }
 }
 
+- (void)spillResponseToTemporaryFile {
+    if (nil == _spilledResponsePath) {
+        NSString *fileName = [kSpilledResponseFilePrefix stringByAppendingString:[[NSProcessInfo processInfo] globallyUniqueString]];
+        _spilledResponsePath = [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
+    }
+    //Forget the response of a previous attempt, the file is re-created below
+    self.spilledResponseData = nil;
+    
+    //Response is read back as plain data by responseAsData. Create the file upfront so that it is protected by the device passcode,
+    //and empty so that the internal operation does not append to the response of a previous attempt
+    [[NSFileManager defaultManager] createFileAtPath:_spilledResponsePath
+                                            contents:nil
+                                          attributes:@{NSFileProtectionKey : NSFileProtectionComplete}];
+    if (_internalOperation) {
+        _internalOperation.encryptDownload = NO;
+        _internalOperation.downloadFile = _spilledResponsePath;
+    }
+}
+
 - (void)setExpectedDownloadSize:(NSUInteger)expectedDownloadSize {
     _expectedDownloadSize = expectedDownloadSize;
     if (_internalOperation) {
@@ -185,6 +392,7 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
     [[self class] deleteUnfinishedDownloadFileForOperation:self.internalOperation];
     
     [_internalOperation cancel];
+    [self.hedge cancel];
 
     __weak SFNetworkOperation *weakSelf = self;
     if (weakSelf.delegate && [weakSelf.delegate respondsToSelector:@selector(networkOperationDidCancel:)]) {
@@ -227,6 +435,8 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
         }
     }
     
+    //Release memory budget held or awaited by this operation
+    [[SFNetworkEngine sharedInstance] startOperationsWaitingForMemoryBudget];
 }
 
 - (void)setQueuePriority:(NSOperationQueuePriority)p {
@@ -270,6 +480,14 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
     }
 }
 
+- (BOOL)shouldDeliverResultOfOperation:(MKNetworkOperation *)operation succeeded:(BOOL)succeeded {
+    SFNetworkHedge *hedge = self.hedge;
+    if (nil == hedge) {
+        return YES;
+    }
+    return [hedge shouldDeliverResultOfOperation:operation succeeded:succeeded];
+}
+
 -(BOOL) canCallback {
     // If we have a coordinator then we can call back.. If not then we are most likely logged out and the block might not be available.
     return [SFNetworkEngine sharedInstance].coordinator?YES:NO;
@@ -280,6 +498,9 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
     if (_internalOperation) {
         __weak SFNetworkOperation *weakSelf = self;
         [_internalOperation addCompletionHandler:^(MKNetworkOperation *completedOperation) {
+            if (![weakSelf shouldDeliverResultOfOperation:completedOperation succeeded:YES]) {
+                return;
+            }
             if([weakSelf canCallback]) {
                 dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
                     //Perform all callbacks in background queue
@@ -295,7 +516,10 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
                 });
             }
         } errorHandler:^(MKNetworkOperation *operation, NSError *error) {
-            NSError *serviceError = [weakSelf checkForErrorInResponseStr:weakSelf.responseAsString withError:error];
+            if (![weakSelf shouldDeliverResultOfOperation:operation succeeded:NO]) {
+                return;
+            }
+            NSError *serviceError = [weakSelf checkForErrorInResponseStr:[weakSelf responseStringForErrorCheck] withError:error];
             if (serviceError) {
                 error = serviceError;
             }
@@ -306,7 +530,7 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
                 return;
             }
             if ([weakSelf shouldRetryOperation:weakSelf onNetworkError:error]) {
-                //do nothing, queueOperationOnNetworkError is handled in callDelegateDidFailWithError
+                //do nothing, queueOperationOnNetworkError:error: is handled in callDelegateDidFailWithError
                 [weakSelf log:SFLogLevelError format:@"Network time out encountered. Actual error: [%@]. Will be retried in callDelegateDidFailWithError", [error localizedDescription]];
                 return;
             }
@@ -385,14 +609,31 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
 
 #pragma mark - Response Methods
 - (NSString *)responseAsString {
+    if (_replayedResponse) {
+        return _replayedResponse.body ? [[NSString alloc] initWithData:_replayedResponse.body encoding:NSUTF8StringEncoding] : nil;
+    }
     if (_internalOperation) {
         if (_internalOperation.isFinished) {
+            if (_spilledResponsePath) {
+                NSData *data = [self responseAsData];
+                return data ? [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] : nil;
+            }
             return _internalOperation.responseString;
         }
     }
     return nil;
 }
 - (id)responseAsJSON {
+    if (_replayedResponse || _spilledResponsePath) {
+        //Check the first character instead of decoding a possibly large response into a string
+        NSData *data = [self responseAsData];
+        char firstCharacter = [[self class] firstNonWhitespaceCharacterOfData:data];
+        if (firstCharacter != '{' && firstCharacter != '[') {
+            //Not JSON format
+            return nil;
+        }
+        return [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+    }
     NSString *responseStr = [self responseAsString];
     if (nil == responseStr || (![responseStr hasPrefix:@"{"] && ![responseStr hasPrefix:@"["])) {
         //Not JSON format
@@ -404,11 +645,39 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
     return nil;
 }
 - (NSData *)responseAsData {
+    if (_replayedResponse) {
+        return _replayedResponse.body;
+    }
+    if (_spilledResponsePath) {
+        if (nil == _spilledResponseData && _internalOperation.isFinished) {
+            self.spilledResponseData = [NSData dataWithContentsOfFile:_spilledResponsePath options:NSDataReadingMappedAlways error:nil];
+        }
+        return _spilledResponseData;
+    }
     if (_internalOperation) {
         return _internalOperation.responseData;
     }
     return nil;
 }
+- (NSString *)responseStringForErrorCheck {
+    if (nil == _spilledResponsePath) {
+        return self.responseAsString;
+    }
+    char firstCharacter = [[self class] firstNonWhitespaceCharacterOfData:[self responseAsData]];
+    if (firstCharacter != '{' && firstCharacter != '[') {
+        return nil;
+    }
+    return [NSString stringWithFormat:@"%c", firstCharacter];
+}
++ (char)firstNonWhitespaceCharacterOfData:(NSData *)data {
+    const char *bytes = data.bytes;
+    for (NSUInteger i = 0; i < data.length; i++) {
+        if (!isspace((unsigned char)bytes[i])) {
+            return bytes[i];
+        }
+    }
+    return 0;
+}
 - (id)responseAsImage {
     if (_internalOperation) {
         return _internalOperation.responseImage;
@@ -445,7 +714,7 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
         return;
     }
     
-    NSError *serviceError = [self checkForErrorInResponseStr:self.responseAsString withError:error];
+    NSError *serviceError = [self checkForErrorInResponseStr:[self responseStringForErrorCheck] withError:error];
     if (serviceError) {
         error = serviceError;
     }
@@ -470,7 +739,7 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
         [weakSelf log:SFLogLevelError format:@"Network error encountered. Requeue % for retry later", weakSelf];
         //Increase the current retry count
         _numOfRetriesForNetworkError++;
-        [[SFNetworkEngine sharedInstance] queueOperationOnNetworkError:weakSelf];
+        [[SFNetworkEngine sharedInstance] queueOperationOnNetworkError:weakSelf error:error];
         return;
     }
     
@@ -551,6 +820,23 @@ static NSString *kDefaultFileDataMimeType = @"multipart/form-data";
         return NO;
     }
 }
++ (void)deleteSpilledResponseFilesCreatedBefore:(NSDate *)date {
+    NSString *directory = NSTemporaryDirectory();
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        for (NSString *fileName in [fileManager contentsOfDirectoryAtPath:directory error:nil]) {
+            if (![fileName hasPrefix:kSpilledResponseFilePrefix]) {
+                continue;
+            }
+            //Files created after date belong to operations of this run
+            NSString *filePath = [directory stringByAppendingPathComponent:fileName];
+            NSDate *creationDate = [[fileManager attributesOfItemAtPath:filePath error:nil] fileCreationDate];
+            if (creationDate && [creationDate compare:date] == NSOrderedAscending) {
+                [fileManager removeItemAtPath:filePath error:nil];
+            }
+        }
+    });
+}
 + (void)deleteUnfinishedDownloadFileForOperation:(MKNetworkOperation *)operation {
     if (nil == operation || nil == operation.downloadFile) {
         return;
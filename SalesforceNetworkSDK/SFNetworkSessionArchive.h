@@ -0,0 +1,107 @@
+//
+//  SFNetworkSessionArchive.h
+//  SalesforceNetworkSDK
+//
+//  Copyright (c) 2013 salesforce.com. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/** Latency used by `SFNetworkEngine` when serving responses from a `SFNetworkSessionArchive`
+
+- SFNetworkReplayLatencyRecorded: Serve each response after the same duration it took when it was recorded
+- SFNetworkReplayLatencyAccelerated: Serve each response after the recorded duration multiplied by `[SFNetworkSessionArchive replayLatencyScale]`
+- SFNetworkReplayLatencyNone: Serve each response as soon as possible
+ */
+typedef enum {
+    SFNetworkReplayLatencyRecorded = 0,
+    SFNetworkReplayLatencyAccelerated,
+    SFNetworkReplayLatencyNone
+} SFNetworkReplayLatency;
+
+/** A single server response captured by `SFNetworkEngine` in `SFNetworkTransportModeRecord` mode
+ */
+@interface SFNetworkRecordedResponse : NSObject
+
+/** Key of the request that produced this response, made of the HTTP method, URL and a hash of the posted fields and file data */
+@property (nonatomic, readonly, copy) NSString *requestKey;
+
+/** HTTP status code of the response */
+@property (nonatomic, readonly, assign) NSInteger statusCode;
+
+/** HTTP headers of the response */
+@property (nonatomic, readonly, copy) NSDictionary *headers;
+
+/** Raw response body */
+@property (nonatomic, readonly, strong) NSData *body;
+
+/** Time in seconds between the request being started and the response being received */
+@property (nonatomic, readonly, assign) NSTimeInterval duration;
+
+/** Create new SFNetworkRecordedResponse
+
+ @param requestKey Key of the request that produced this response
+ @param statusCode HTTP status code
+ @param headers HTTP response headers
+ @param body Raw response body
+ @param duration Time in seconds taken to receive the response
+ */
+- (id)initWithRequestKey:(NSString *)requestKey statusCode:(NSInteger)statusCode headers:(NSDictionary *)headers body:(NSData *)body duration:(NSTimeInterval)duration;
+@end
+
+/**
+ Indexed archive of recorded server responses
+
+ `SFNetworkEngine` appends every completed operation to its `[SFNetworkEngine sessionArchive]` when `[SFNetworkEngine transportMode]` is `SFNetworkTransportModeRecord`,
+ and serves responses from it without opening a connection when `[SFNetworkEngine transportMode]` is `SFNetworkTransportModeReplay`.
+
+ On disk, an archive is a small binary property list index followed by all response bodies. When loaded with `initWithContentsOfFile:error:`
+ the file is memory-mapped, so only the bodies actually replayed are paged in.
+
+ When the same request was recorded more than once, replay serves the recorded responses in order and starts over from the first one once all of them have been served.
+ */
+@interface SFNetworkSessionArchive : NSObject
+
+/** Latency to apply when replaying responses. Default value is `SFNetworkReplayLatencyRecorded` */
+@property (nonatomic, assign) SFNetworkReplayLatency replayLatency;
+
+/** Multiplier applied to recorded durations when `replayLatency` is `SFNetworkReplayLatencyAccelerated`. Default value is 0.1 */
+@property (nonatomic, assign) double replayLatencyScale;
+
+/** Number of responses stored in this archive */
+@property (nonatomic, readonly, assign) NSUInteger count;
+
+/** Load an archive previously saved with `writeToFile:error:`
+
+ @param path Full path to the archive file
+ @param error Set to the reason of the failure if the archive can not be loaded
+ @return the loaded archive, or nil if the file does not exist or is not a valid archive
+ */
+- (id)initWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+/** Append a response to this archive
+
+ @param response Response to append
+ */
+- (void)addResponse:(SFNetworkRecordedResponse *)response;
+
+/** Return the next recorded response for the specified request key, or nil if the request was never recorded
+
+ @param requestKey Request key. See `[SFNetworkRecordedResponse requestKey]`
+ */
+- (SFNetworkRecordedResponse *)responseForRequestKey:(NSString *)requestKey;
+
+/** Return the delay in seconds to wait before serving the specified response, based on `replayLatency`
+
+ @param response Response to be served
+ */
+- (NSTimeInterval)replayDelayForResponse:(SFNetworkRecordedResponse *)response;
+
+/** Save all responses in this archive to a file
+
+ @param path Full path to the archive file. Existing file, including the file this archive was loaded from, is atomically replaced once the new file is completely written
+ @param error Set to the reason of the failure if the archive can not be saved
+ @return YES if the archive is saved successfully
+ */
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error;
+@end
@@ -0,0 +1,363 @@
+//
+//  SFNetworkSessionArchive.m
+//  SalesforceNetworkSDK
+//
+//  Copyright (c) 2013 salesforce.com. All rights reserved.
+//
+
+#import "SFNetworkSessionArchive.h"
+
+static uint32_t const kArchiveMagic = 0x53464E41; //"SFNA"
+static uint32_t const kArchiveVersion = 1;
+static NSUInteger const kArchiveHeaderLength = 3 * sizeof(uint32_t);
+static double const kDefaultReplayLatencyScale = 0.1;
+
+//Keys used in the archive index
+static NSString * const kIndexRequestKey = @"k";
+static NSString * const kIndexStatusCodeKey = @"s";
+static NSString * const kIndexHeadersKey = @"h";
+static NSString * const kIndexDurationKey = @"d";
+static NSString * const kIndexOffsetKey = @"o";
+static NSString * const kIndexLengthKey = @"l";
+
+@implementation SFNetworkRecordedResponse
+@synthesize requestKey = _requestKey;
+@synthesize statusCode = _statusCode;
+@synthesize headers = _headers;
+@synthesize body = _body;
+@synthesize duration = _duration;
+
+- (id)initWithRequestKey:(NSString *)requestKey statusCode:(NSInteger)statusCode headers:(NSDictionary *)headers body:(NSData *)body duration:(NSTimeInterval)duration {
+    self = [super init];
+    if (self) {
+        _requestKey = [requestKey copy];
+        _statusCode = statusCode;
+        _headers = [headers copy];
+        _body = body;
+        _duration = duration;
+    }
+    return self;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %@ status %ld, %lu bytes in %.3fs>", NSStringFromClass([self class]), _requestKey, (long)_statusCode, (unsigned long)_body.length, _duration];
+}
+@end
+
+@interface SFNetworkSessionArchive ()
+
+/** Memory-mapped content of the archive file this archive was loaded from. nil for an archive created with `init` */
+@property (nonatomic, strong) NSData *mappedData;
+
+/** Offset in `mappedData` where response bodies start */
+@property (nonatomic, assign) NSUInteger bodyOffset;
+
+/** Recorded entries keyed by request key, in recording order
+
+ Each entry is either a `SFNetworkRecordedResponse` added with `addResponse:` or an index dictionary read from `mappedData`
+ */
+@property (nonatomic, strong) NSMutableDictionary *entries;
+
+/** Request keys in the order they were first recorded */
+@property (nonatomic, strong) NSMutableArray *orderedKeys;
+
+/** Index of the next entry to serve for each request key */
+@property (nonatomic, strong) NSMutableDictionary *replayCursors;
+
+/** Append an entry to the list of entries recorded for the specified request key
+
+ @param entry `SFNetworkRecordedResponse` or index dictionary
+ @param requestKey Request key
+ */
+- (void)addEntry:(id)entry forRequestKey:(NSString *)requestKey;
+
+/** Return YES if the specified object read from the archive index is a well-formed index dictionary whose body lies within `mappedData`
+
+ @param indexEntry Object read from the archive index
+ */
+- (BOOL)isValidIndexEntry:(id)indexEntry;
+
+/** Return body data for the specified index entry read from `mappedData`
+
+ @param indexEntry Index dictionary
+ */
+- (NSData *)bodyForIndexEntry:(NSDictionary *)indexEntry;
+@end
+
+@implementation SFNetworkSessionArchive
+@synthesize replayLatency = _replayLatency;
+@synthesize replayLatencyScale = _replayLatencyScale;
+@synthesize count = _count;
+@synthesize mappedData = _mappedData;
+@synthesize bodyOffset = _bodyOffset;
+@synthesize entries = _entries;
+@synthesize orderedKeys = _orderedKeys;
+@synthesize replayCursors = _replayCursors;
+
+#pragma mark - Initialization
+- (id)init {
+    self = [super init];
+    if (self) {
+        //Set default value
+        _replayLatency = SFNetworkReplayLatencyRecorded;
+        _replayLatencyScale = kDefaultReplayLatencyScale;
+        _entries = [[NSMutableDictionary alloc] init];
+        _orderedKeys = [[NSMutableArray alloc] init];
+        _replayCursors = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (id)initWithContentsOfFile:(NSString *)path error:(NSError **)error {
+    self = [self init];
+    if (self) {
+        NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:error];
+        if (nil == data) {
+            return nil;
+        }
+
+        NSError *corruptError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{NSFilePathErrorKey : path}];
+        if (data.length < kArchiveHeaderLength) {
+            if (error) {
+                *error = corruptError;
+            }
+            return nil;
+        }
+
+        uint32_t header[3];
+        [data getBytes:header length:kArchiveHeaderLength];
+        uint32_t magic = CFSwapInt32BigToHost(header[0]);
+        uint32_t version = CFSwapInt32BigToHost(header[1]);
+        NSUInteger indexLength = CFSwapInt32BigToHost(header[2]);
+        if (magic != kArchiveMagic || version != kArchiveVersion || indexLength > data.length - kArchiveHeaderLength) {
+            if (error) {
+                *error = corruptError;
+            }
+            return nil;
+        }
+
+        NSData *indexData = [data subdataWithRange:NSMakeRange(kArchiveHeaderLength, indexLength)];
+        id index = [NSPropertyListSerialization propertyListWithData:indexData options:NSPropertyListImmutable format:NULL error:error];
+        if (![index isKindOfClass:[NSArray class]]) {
+            if (error && index) {
+                *error = corruptError;
+            }
+            return nil;
+        }
+
+        _mappedData = data;
+        _bodyOffset = kArchiveHeaderLength + indexLength;
+        for (id indexEntry in index) {
+            if (![self isValidIndexEntry:indexEntry]) {
+                if (error) {
+                    *error = corruptError;
+                }
+                return nil;
+            }
+            [self addEntry:indexEntry forRequestKey:indexEntry[kIndexRequestKey]];
+        }
+    }
+    return self;
+}
+
+- (BOOL)isValidIndexEntry:(id)indexEntry {
+    if (![indexEntry isKindOfClass:[NSDictionary class]]) {
+        return NO;
+    }
+    id requestKey = indexEntry[kIndexRequestKey];
+    id statusCode = indexEntry[kIndexStatusCodeKey];
+    id headers = indexEntry[kIndexHeadersKey];
+    id duration = indexEntry[kIndexDurationKey];
+    id offset = indexEntry[kIndexOffsetKey];
+    id length = indexEntry[kIndexLengthKey];
+    if (![requestKey isKindOfClass:[NSString class]]
+        || ![statusCode isKindOfClass:[NSNumber class]]
+        || (nil != headers && ![headers isKindOfClass:[NSDictionary class]])
+        || ![duration isKindOfClass:[NSNumber class]]
+        || ![offset isKindOfClass:[NSNumber class]]
+        || ![length isKindOfClass:[NSNumber class]]) {
+        return NO;
+    }
+    if ([offset longLongValue] < 0 || [length longLongValue] < 0) {
+        return NO;
+    }
+
+    //Compare against the remaining length so that large values can not overflow
+    unsigned long long bodiesLength = self.mappedData.length - self.bodyOffset;
+    unsigned long long bodyOffset = [offset unsignedLongLongValue];
+    unsigned long long bodyLength = [length unsignedLongLongValue];
+    return bodyOffset <= bodiesLength && bodyLength <= bodiesLength - bodyOffset;
+}
+
+#pragma mark - Record Methods
+- (void)addResponse:(SFNetworkRecordedResponse *)response {
+    if (nil == response || nil == response.requestKey) {
+        return;
+    }
+    [self addEntry:response forRequestKey:response.requestKey];
+}
+
+- (void)addEntry:(id)entry forRequestKey:(NSString *)requestKey {
+    @synchronized(self) {
+        NSMutableArray *entriesForKey = self.entries[requestKey];
+        if (nil == entriesForKey) {
+            entriesForKey = [NSMutableArray arrayWithCapacity:1];
+            self.entries[requestKey] = entriesForKey;
+            [self.orderedKeys addObject:requestKey];
+        }
+        [entriesForKey addObject:entry];
+        _count++;
+    }
+}
+
+#pragma mark - Replay Methods
+- (SFNetworkRecordedResponse *)responseForRequestKey:(NSString *)requestKey {
+    if (nil == requestKey) {
+        return nil;
+    }
+
+    id entry = nil;
+    @synchronized(self) {
+        NSArray *entriesForKey = self.entries[requestKey];
+        if (entriesForKey.count == 0) {
+            return nil;
+        }
+        NSUInteger cursor = [self.replayCursors[requestKey] unsignedIntegerValue] % entriesForKey.count;
+        entry = entriesForKey[cursor];
+        self.replayCursors[requestKey] = @(cursor + 1);
+    }
+
+    if ([entry isKindOfClass:[SFNetworkRecordedResponse class]]) {
+        return entry;
+    }
+    NSDictionary *indexEntry = (NSDictionary *)entry;
+    return [[SFNetworkRecordedResponse alloc] initWithRequestKey:requestKey
+                                                      statusCode:[indexEntry[kIndexStatusCodeKey] integerValue]
+                                                         headers:indexEntry[kIndexHeadersKey]
+                                                            body:[self bodyForIndexEntry:indexEntry]
+                                                        duration:[indexEntry[kIndexDurationKey] doubleValue]];
+}
+
+- (NSTimeInterval)replayDelayForResponse:(SFNetworkRecordedResponse *)response {
+    switch (self.replayLatency) {
+        case SFNetworkReplayLatencyRecorded:
+            return response.duration;
+        case SFNetworkReplayLatencyAccelerated:
+            return response.duration * self.replayLatencyScale;
+        default:
+            return 0;
+    }
+}
+
+- (NSData *)bodyForIndexEntry:(NSDictionary *)indexEntry {
+    NSUInteger offset = [indexEntry[kIndexOffsetKey] unsignedIntegerValue];
+    NSUInteger length = [indexEntry[kIndexLengthKey] unsignedIntegerValue];
+    return [self.mappedData subdataWithRange:NSMakeRange(self.bodyOffset + offset, length)];
+}
+
+#pragma mark - Save Methods
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error {
+    NSMutableArray *allEntries = [NSMutableArray array];
+    @synchronized(self) {
+        for (NSString *requestKey in self.orderedKeys) {
+            [allEntries addObjectsFromArray:self.entries[requestKey]];
+        }
+    }
+
+    //Build index first so that body offsets are known before anything is written
+    NSMutableArray *index = [NSMutableArray arrayWithCapacity:allEntries.count];
+    NSUInteger offset = 0;
+    for (id entry in allEntries) {
+        NSMutableDictionary *indexEntry = nil;
+        NSUInteger length = 0;
+        if ([entry isKindOfClass:[SFNetworkRecordedResponse class]]) {
+            SFNetworkRecordedResponse *response = (SFNetworkRecordedResponse *)entry;
+            indexEntry = [NSMutableDictionary dictionaryWithCapacity:6];
+            indexEntry[kIndexRequestKey] = response.requestKey;
+            indexEntry[kIndexStatusCodeKey] = @(response.statusCode);
+            indexEntry[kIndexDurationKey] = @(response.duration);
+            if (response.headers) {
+                indexEntry[kIndexHeadersKey] = response.headers;
+            }
+            length = response.body.length;
+        } else {
+            indexEntry = [NSMutableDictionary dictionaryWithDictionary:entry];
+            length = [entry[kIndexLengthKey] unsignedIntegerValue];
+        }
+        indexEntry[kIndexOffsetKey] = @(offset);
+        indexEntry[kIndexLengthKey] = @(length);
+        [index addObject:indexEntry];
+        offset += length;
+    }
+
+    NSData *indexData = [NSPropertyListSerialization dataWithPropertyList:index format:NSPropertyListBinaryFormat_v1_0 options:0 error:error];
+    if (nil == indexData) {
+        return NO;
+    }
+
+    //Write to a temporary file next to the target and rename it over the target once complete, so that the target,
+    //which may be the file this archive is memory-mapped from, is never truncated
+    NSString *temporaryPath = [path stringByAppendingFormat:@".%@.tmp", [[NSProcessInfo processInfo] globallyUniqueString]];
+    if (![[NSFileManager defaultManager] createFileAtPath:temporaryPath contents:nil attributes:nil]) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{NSFilePathErrorKey : path}];
+        }
+        return NO;
+    }
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingAtPath:temporaryPath];
+    if (nil == fileHandle) {
+        [[NSFileManager defaultManager] removeItemAtPath:temporaryPath error:nil];
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{NSFilePathErrorKey : path}];
+        }
+        return NO;
+    }
+
+    //NSFileHandle reports write failures, e.g. a full disk, by raising an exception
+    BOOL written = YES;
+    NSString *failureReason = nil;
+    @try {
+        uint32_t header[3] = { CFSwapInt32HostToBig(kArchiveMagic), CFSwapInt32HostToBig(kArchiveVersion), CFSwapInt32HostToBig((uint32_t)indexData.length) };
+        [fileHandle writeData:[NSData dataWithBytes:header length:kArchiveHeaderLength]];
+        [fileHandle writeData:indexData];
+        for (id entry in allEntries) {
+            NSData *body = nil;
+            if ([entry isKindOfClass:[SFNetworkRecordedResponse class]]) {
+                body = [(SFNetworkRecordedResponse *)entry body];
+            } else {
+                body = [self bodyForIndexEntry:entry];
+            }
+            if (body.length > 0) {
+                [fileHandle writeData:body];
+            }
+        }
+        [fileHandle synchronizeFile];
+    }
+    @catch (NSException *exception) {
+        written = NO;
+        failureReason = [exception reason];
+    }
+    @finally {
+        [fileHandle closeFile];
+    }
+
+    //rename() atomically replaces the target. Pages already mapped from the old file stay valid until it is unmapped
+    if (written && 0 != rename([temporaryPath fileSystemRepresentation], [path fileSystemRepresentation])) {
+        written = NO;
+        failureReason = [NSString stringWithUTF8String:strerror(errno)];
+    }
+
+    if (!written) {
+        [[NSFileManager defaultManager] removeItemAtPath:temporaryPath error:nil];
+        if (error) {
+            NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:path forKey:NSFilePathErrorKey];
+            if (failureReason) {
+                userInfo[NSLocalizedFailureReasonErrorKey] = failureReason;
+            }
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:userInfo];
+        }
+        return NO;
+    }
+    return YES;
+}
+@end
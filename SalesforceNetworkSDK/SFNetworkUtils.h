@@ -21,6 +21,7 @@
 - SFNetworkOperationErrorTypeURLNoLongerExists: URL no longer exists error, error code 404. Typical error when trying to get to a resource that is already deleted on the server
 - SFNetworkOperationErrorTypeInternalServerError: Remote server internal error, error code 500. Typical error when remote server is temporarialy down
 - SFNetworkOperationErrorTypeUnknown: For other errors that has error code not matching one of the above
+- SFNetworkOperationErrorTypeCircuitOpen: Operation was not sent because the circuit breaker of its endpoint is open, error domain `kSFNetworkErrorDomain` and error code `kSFNetworkErrorCodeCircuitOpen`. See `[SFNetworkEngine enableCircuitBreakers]`
  */
 typedef enum {
     SFNetworkOperationErrorTypeNetworkError = 0,
@@ -31,9 +32,12 @@ typedef enum {
     SFNetworkOperationErrorTypeAPILimitReached,
     SFNetworkOperationErrorTypeURLNoLongerExists,
     SFNetworkOperationErrorTypeInternalServerError,
-    SFNetworkOperationErrorTypeUnknown
+    SFNetworkOperationErrorTypeUnknown,
+    SFNetworkOperationErrorTypeCircuitOpen
 } SFNetworkOperationErrorType;
 
+extern NSString * const kSFNetworkErrorDomain;
+extern NSInteger const kSFNetworkErrorCodeCircuitOpen;
 extern NSString * const kErrorCodeKeyInResponse;
 extern NSString * const kErrorMessageKeyInResponse;
 extern NSString * const kSFOriginalApiError;
@@ -8,6 +8,8 @@
 
 #import "SFNetworkUtils.h"
 
+NSString * const kSFNetworkErrorDomain = @"SFNetworkErrorDomain";
+NSInteger const kSFNetworkErrorCodeCircuitOpen = 1;
 NSString * const kErrorCodeKeyInResponse = @"errorCode";
 NSString * const kErrorMessageKeyInResponse = @"message";
 NSString * const kSFOriginalApiError = @"SFOriginalApiError";
@@ -77,6 +79,9 @@ NSString * const kInvalidSessionID = @"INVALID_SESSION_ID";
     if (error == nil) {
         return SFNetworkOperationErrorTypeUnknown;
     }
+    if ([error.domain isEqualToString:kSFNetworkErrorDomain] && error.code == kSFNetworkErrorCodeCircuitOpen) {
+        return SFNetworkOperationErrorTypeCircuitOpen;
+    }
     if ([[self class] isNetworkError:error]){
         return SFNetworkOperationErrorTypeNetworkError;
     }